@@ -14,23 +14,42 @@
 #include "button.h"
 #include "sensors.h"
 #include "motor.h"
+#include "lcdbuffer.h"
+#include "adc.h"
+#include "eepromwriter.h"
+#include "store.h"
+#include "faults.h"
+#include "trend.h"
 
 // Constructors
-#define LCD_ADDRESS 0x27
-#define LCD_ROWS 2
-#define LCD_COLS 16
-LiquidCrystal_I2C lcd(LCD_ADDRESS, LCD_COLS, LCD_ROWS);
+LCDDriver lcdDevice(LCD_ADDRESS);
+LCDBuffer lcd(lcdDevice);
 
 State state;
+AdcSampler adcSampler;
+EepromWriter eepromWriter;
+EepromStore store(eepromWriter);
+FaultRecorder faultRecorder(eepromWriter);
+TrendLogger trendLog(eepromWriter);
 DisplayManager displays(lcd);
 Button button(PIN_BUTTON);
 SensorManager sensors;
 Motor motor;
 
-// Variables for rpm measurement
-volatile uint32_t rpmCurTime = 0;
-volatile uint32_t rpmPrevTime = 0;
-volatile bool rpmRotationFlag = false;
+// Variables for rpm measurement. Times are in Timer1 ticks.
+IsrQueue<uint32_t, RPM_QUEUE_LENGTH> rpmPeriods; // Periods of each rotation.
+uint32_t rpmLastTime = 0; // Only used inside ISRs.
+uint8_t rpmShortPeriods = 0; // Consecutive periods shorter than RPM_MIN_PERIOD. Only used inside ISRs.
+volatile bool rpmOverRev = false; // Set once the ISR stopped the engine for over revving.
+volatile uint16_t rpmTimerOverflows = 0; // Upper 16 bits of the Timer1 time.
+
+bool powerSaved = false; // Set once everything was saved for the current power failure.
+
+void powerFail();
+#ifdef LOOP_TIMING
+int freeMemory();
+void timeLoop(const uint32_t start);
+#endif
 
 void setup()
 {
@@ -45,23 +64,44 @@ void setup()
     // Setup the sensors and states
     state.engineState = STOPPED;
     state.rpm = 0;
+    state.overRevved = false;
+    state.probeFault = false;
+    state.thermistorsDisagree = false;
+    state.probeWarning = false;
+    state.oilPressure = false;
+    state.oilExpected = false;
     state.temperature = 0;
+    state.thermistors[0] = 0;
+    state.thermistors[1] = 0;
     state.totalMinutes = 0;
     state.tripMinutes = 0;
+    adcSampler.begin();
+    store.begin();
     sensors.begin();
+    faultRecorder.begin(store.address(STORE_FAULTS), store.seed(STORE_FAULTS));
+    trendLog.begin(store.address(STORE_TRENDS), store.seed(STORE_TRENDS)); // After the hours are restored.
+    store.save(); // After sensors have imported anything they need from the old layout.
 
     // Set up the lcd
-    lcd.init();
-    lcd.backlight();
+    lcd.begin();
 
     // Setup the button
     button.begin();
     // Show some stuff
     displays.activate(DISP_INIT);
+
+#ifdef LOOP_TIMING
+    Serial.print(F("Free SRAM: "));
+    Serial.println(freeMemory());
+#endif
 }
 
 void loop()
 {
+#ifdef LOOP_TIMING
+    uint32_t loopStart = micros();
+#endif
+
     // Swap from the init display to home screen if needed.
     uint32_t curTime = millis();
     if (curTime > STARTUP_DELAY && displays.currentIndex == DISP_INIT)
@@ -70,30 +110,139 @@ void loop()
         displays.activate(DISP_HOME);
     }
 
-    // Update all the displays.
+    // Run any display updates that are due.
     displays.tick();
     button.check();
     sensors.tick();
 
-    // Update the sensors every so often.
-    static uint32_t prevTime = curTime - SENSOR_UPDATE_INTERVAL - 1; // Run first time
-    if (curTime - prevTime > SENSOR_UPDATE_INTERVAL)
+    // Save what needs saving while the capacitors hold the power up. Only
+    // once per failure, then carry on as normal in case it was a dip or the
+    // battery sense wire is broken and the engine is still running.
+    if (adcSampler.powerFailing())
     {
-        prevTime = curTime;
-        // Get new data
-        sensors.addState();
+        if (!powerSaved)
+        {
+            powerFail();
+            powerSaved = true;
+        }
+    }
+    else if (powerSaved)
+    {
+        Serial.println(F("Power recovered"));
+        powerSaved = false;
+        lcd.backlight();
+    }
+
+    // Take readings from any sensors that are due and check for issues
+    // straight away.
+    if (sensors.addState(curTime) && !state.updateEngineState())
+    {
+        // There were.
+        motor.shutdown();
+        faultRecorder.record(state.engineState);
+        displays.activate(DISP_ERROR);
+    }
 
-        // Check if there are issues
-        if (!state.updateEngineState())
+    // Sample for the logs and save them a bit at a time.
+    faultRecorder.tick(curTime);
+    trendLog.tick(curTime);
+
+    // Start sending the logs when asked. The rest is printed a line at a time
+    // by tick().
+    if (Serial.available())
+    {
+        switch (Serial.read())
         {
-            // There were.
-            motor.shutdown();
-            displays.activate(DISP_ERROR);
+        case 'f':
+            faultRecorder.dump(Serial);
+            break;
+        case 't':
+            trendLog.dump(Serial);
+            break;
         }
+    }
+
+    // Update the displays every so often.
+    static uint32_t prevTime = curTime - DISPLAY_UPDATE_INTERVAL - 1; // Run first time
+    if (curTime - prevTime > DISPLAY_UPDATE_INTERVAL)
+    {
+        prevTime = curTime;
         displays.updateState();
     }
+
+    // Send some of what changed on the screen to the LCD. This is limited so
+    // that drawing a whole screen doesn't hold up the rest of the loop.
+    lcd.flush();
+
+#ifdef LOOP_TIMING
+    timeLoop(loopStart);
+#endif
 }
 
+/**
+ * @brief Saves everything to EEPROM when the battery rail drops (the ignition
+ * was turned off).
+ *
+ * The records were encoded ahead of time so they only need to be queued. Returns
+ * once they are written so that loop() carries on if the power doesn't go.
+ *
+ */
+void powerFail()
+{
+    lcd.noBacklight(); // Save power for the EEPROM writes.
+    sensors.time.powerFail();
+    faultRecorder.flush();
+    trendLog.flush();
+    while (eepromWriter.busy())
+    {
+    }
+    Serial.println(F("Power failing. Saved"));
+}
+
+#ifdef LOOP_TIMING
+/**
+ * @brief Gets the bytes between the heap (or the static variables if nothing
+ * was allocated) and the stack.
+ *
+ */
+int freeMemory()
+{
+    extern int __heap_start, *__brkval;
+    int top;
+    return (int)&top - (__brkval ? (int)__brkval : (int)&__heap_start);
+}
+
+/**
+ * @brief Adds up how long each loop() took and prints the mean and longest
+ * every LOOP_TIMING_INTERVAL ms. The time taken to print is left out.
+ *
+ * @param start micros() at the start of the loop.
+ */
+void timeLoop(const uint32_t start)
+{
+    static uint32_t total = 0, longest = 0, loops = 0;
+    static uint32_t printTime = millis();
+    uint32_t taken = micros() - start;
+    total += taken;
+    longest = max(longest, taken);
+    loops++;
+
+    if (millis() - printTime >= LOOP_TIMING_INTERVAL)
+    {
+        Serial.print(F("Loop us: mean "));
+        Serial.print(total / loops);
+        Serial.print(F(", longest "));
+        Serial.print(longest);
+        Serial.print(F(", loops "));
+        Serial.println(loops);
+        total = 0;
+        longest = 0;
+        loops = 0;
+        printTime = millis();
+    }
+}
+#endif
+
 /**
  * @brief Function to handle long button presses.
  *
@@ -108,6 +257,17 @@ void btnLongPress()
     lcd.backlight();
 }
 
+/**
+ * @brief Function to handle medium button presses.
+ *
+ * This zooms the graph on the current screen if it has one.
+ *
+ */
+void btnMediumPress()
+{
+    displays.zoom();
+}
+
 /**
  * @brief Function to handle short button presses.
  *
@@ -120,20 +280,112 @@ void btnShortPress()
 }
 
 /**
- * @brief ISR for RPM interrupts.
+ * @brief Records a rotation.
  *
  * Relates to code in sensors.h and sensors.cpp.
  *
+ * @param now the time of the rotation in Timer1 ticks.
  */
-void rpmInterrupt()
+static inline void rpmRotation(uint32_t now)
 {
-    uint32_t now = micros();
-    if (now - rpmCurTime >= RPM_DEBOUNCE_TIME)
+    uint32_t period = now - rpmLastTime;
+    if (period >= RPM_DEBOUNCE_TIME * RPM_TICKS_PER_US)
     {
         // Switch closed and no event interrupts for the last little while.
         // Assume this is a genuine rotation and not switch bounce.
-        rpmPrevTime = rpmCurTime;
-        rpmCurTime = now;
-        rpmRotationFlag = true;
+        rpmLastTime = now;
+        rpmPeriods.push(period); // If the main loop is this far behind, dropping is fine.
+
+        // Stop the engine straight away if it is over revving rather than
+        // waiting for the next time the state is checked.
+        if (period < RPM_MIN_PERIOD)
+        {
+            if (++rpmShortPeriods >= RPM_OVERREV_PERIODS)
+            {
+                rpmShortPeriods = RPM_OVERREV_PERIODS; // Don't overflow.
+                motor.stop();
+                rpmOverRev = true;
+            }
+        }
+        else
+        {
+            rpmShortPeriods = 0;
+        }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Extends a 16 bit Timer1 count to 32 bits using the overflow count.
+ *
+ * Must be called with interrupts disabled.
+ *
+ * @param count the 16 bit count.
+ * @return uint32_t the 32 bit time in ticks.
+ */
+static inline uint32_t rpmExtendTime(uint16_t count)
+{
+    uint16_t high = rpmTimerOverflows;
+    if ((TIFR1 & _BV(TOV1)) && count < 0x8000)
+    {
+        // The timer overflowed before the count was taken, but the overflow
+        // ISR hasn't run yet.
+        high++;
+    }
+    return ((uint32_t)high << 16) | count;
+}
+
+/**
+ * @brief ISR for Timer1 overflowing.
+ *
+ */
+ISR(TIMER1_OVF_vect)
+{
+    rpmTimerOverflows++;
+}
+
+#ifdef RPM_INPUT_CAPTURE
+/**
+ * @brief ISR for RPM input capture events.
+ *
+ * The timer value was latched by hardware when the edge happened, so the time
+ * doesn't depend on how long it took for this ISR to start.
+ *
+ */
+ISR(TIMER1_CAPT_vect)
+{
+    rpmRotation(rpmExtendTime(ICR1));
+}
+#else
+/**
+ * @brief ISR for RPM interrupts.
+ *
+ * Relates to code in sensors.h and sensors.cpp.
+ *
+ */
+void rpmInterrupt()
+{
+    rpmRotation(rpmExtendTime(TCNT1));
+}
+#endif
+
+/**
+ * @brief ISR for the ADC finishing a conversion.
+ *
+ * Relates to code in adc.h and adc.cpp.
+ *
+ */
+ISR(ADC_vect)
+{
+    adcSampler.conversionComplete();
+}
+
+/**
+ * @brief ISR for the EEPROM being ready for the next write.
+ *
+ * Relates to code in eepromwriter.h and eepromwriter.cpp.
+ *
+ */
+ISR(EE_READY_vect)
+{
+    eepromWriter.ready();
+}
@@ -0,0 +1,106 @@
+/**
+ * @file adc.cpp
+ * @brief Interrupt driven sampling of the analog inputs.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-21
+ */
+#include "adc.h"
+
+static_assert(ADC_OVERSAMPLE <= 64, "The sum of ADC_OVERSAMPLE 10 bit samples must fit in 16 bits.");
+
+// Order matches AdcChannel.
+static const uint8_t ADC_PINS[ADC_CHANNELS] = {PIN_BATTERY, PIN_THERMISTOR_1, PIN_THERMISTOR_2};
+
+// Order channels are sampled in. The battery is every second one so that power
+// failing is noticed quickly.
+static const AdcChannel ADC_SEQUENCE[] = {ADC_BATTERY, ADC_THERMISTOR_1, ADC_BATTERY, ADC_THERMISTOR_2};
+static const uint8_t ADC_SEQUENCE_LENGTH = sizeof(ADC_SEQUENCE) / sizeof(ADC_SEQUENCE[0]);
+
+// Raw battery readings for power failing and recovering.
+static const uint16_t POWER_FAIL_RAW = (uint32_t)POWER_FAIL_VOLTAGE * CAL_BATT_DENOMINATOR / CAL_BATT_NUMERATOR;
+static const uint16_t POWER_RECOVER_RAW = (uint32_t)POWER_RECOVER_VOLTAGE * CAL_BATT_DENOMINATOR / CAL_BATT_NUMERATOR;
+
+void AdcSampler::begin()
+{
+    // Disable the digital input buffers on the analog pins.
+    for (uint8_t i = 0; i < ADC_CHANNELS; i++)
+    {
+        DIDR0 |= _BV(ADC_PINS[i] - A0);
+    }
+
+    // Prescaler of 128 gives the 125kHz ADC clock needed for 10 bits.
+    ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADIF) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+    ADCSRB = 0;
+    step = 0;
+    channel = ADC_SEQUENCE[0];
+    sum = 0;
+    count = 0;
+    start();
+
+    // Wait for a full pass so that sensors don't read 0 on startup.
+    while (filled != _BV(ADC_CHANNELS) - 1)
+    {
+    }
+}
+
+void AdcSampler::conversionComplete()
+{
+    uint16_t value = ADC;
+    // The sample and hold capacitor might not have settled for the first few
+    // samples after changing channels.
+    if (count++ >= ADC_SETTLE_SAMPLES)
+    {
+        sum += value;
+
+        // Check every battery sample rather than waiting for the average.
+        if (channel == ADC_BATTERY)
+        {
+            if (value < POWER_FAIL_RAW)
+            {
+                // Several in a row so that a single noisy sample doesn't
+                // count. Only once the rail has been up, so that running from
+                // USB with no battery doesn't look like a power failure.
+                if (lowSamples < POWER_FAIL_SAMPLES && ++lowSamples == POWER_FAIL_SAMPLES)
+                {
+                    powerFail = powerGood;
+                }
+            }
+            else
+            {
+                lowSamples = 0;
+                if (value > POWER_RECOVER_RAW)
+                {
+                    powerFail = false;
+                    powerGood = true;
+                }
+            }
+        }
+    }
+
+    if (count == ADC_SETTLE_SAMPLES + ADC_OVERSAMPLE)
+    {
+        // Publish to the slot readers aren't using and move to the next channel.
+        uint8_t mask = _BV(channel);
+        uint8_t slot = (latest & mask) ? 0 : 1;
+        results[channel][slot] = sum;
+        latest ^= mask;
+        filled |= mask;
+        step = step + 1 == ADC_SEQUENCE_LENGTH ? 0 : step + 1;
+        channel = ADC_SEQUENCE[step];
+        sum = 0;
+        count = 0;
+    }
+    start();
+}
+
+void AdcSampler::start()
+{
+    if (!count)
+    {
+        // AVcc reference.
+        ADMUX = _BV(REFS0) | (ADC_PINS[channel] - A0);
+    }
+    ADCSRA |= _BV(ADSC);
+}
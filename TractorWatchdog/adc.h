@@ -0,0 +1,88 @@
+/**
+ * @file adc.h
+ * @brief Interrupt driven sampling of the analog inputs.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-21
+ */
+#pragma once
+#include "defines.h"
+
+/**
+ * @brief Analog inputs that are sampled.
+ *
+ */
+enum AdcChannel : uint8_t
+{
+    ADC_BATTERY,
+    ADC_THERMISTOR_1,
+    ADC_THERMISTOR_2,
+    ADC_CHANNELS
+};
+
+/**
+ * @brief Samples each analog input in turn from the ADC conversion complete
+ * interrupt.
+ *
+ * Each channel is sampled ADC_OVERSAMPLE times in a row and the sum is stored
+ * in one of two slots. Readers always get the slot that isn't being written, so
+ * reading never blocks or needs interrupts disabled.
+ *
+ */
+class AdcSampler
+{
+public:
+    /**
+     * @brief Sets up the ADC and waits until every channel has a result.
+     *
+     * Interrupts need to be enabled.
+     */
+    void begin();
+
+    /**
+     * @brief Gets the latest result for a channel.
+     *
+     * @param channel the channel.
+     * @return uint16_t the sum of ADC_OVERSAMPLE samples (0 to 1023 *
+     *         ADC_OVERSAMPLE).
+     */
+    uint16_t read(const AdcChannel channel) const
+    {
+        return results[channel][(latest >> channel) & 1];
+    }
+
+    /**
+     * @brief Checks if the battery rail has dropped below POWER_FAIL_VOLTAGE
+     * and not yet recovered above POWER_RECOVER_VOLTAGE.
+     *
+     * Every raw sample is checked, so this is set within a few ms.
+     */
+    bool powerFailing() const { return powerFail; }
+
+    /**
+     * @brief Call from the ADC conversion complete ISR.
+     *
+     */
+    void conversionComplete();
+
+private:
+    /**
+     * @brief Selects a channel and starts a conversion.
+     *
+     */
+    void start();
+
+    volatile uint16_t results[ADC_CHANNELS][2];
+    volatile uint8_t latest = 0; // Bit for each channel of which slot was written last.
+    volatile uint8_t filled = 0; // Bit for each channel that has a result.
+    volatile bool powerFail = false;
+    bool powerGood = false; // Set once the battery rail has been above POWER_RECOVER_VOLTAGE.
+    uint8_t lowSamples = 0; // Battery samples in a row below POWER_FAIL_VOLTAGE.
+
+    // Only used inside the ISR.
+    uint16_t sum;
+    uint8_t count; // Samples taken of the current channel, including ones discarded.
+    uint8_t channel;
+    uint8_t step; // Position in the sequence of channels.
+};
@@ -9,6 +9,7 @@
 #include "button.h"
 
 extern void btnLongPress();
+extern void btnMediumPress();
 extern void btnShortPress();
 
 void Button::begin()
@@ -54,9 +55,20 @@ void Button::check()
         isPressed = false;
         longEnabled = true;
 
-        // Long or short press? Only call for a short press as long is called on
-        // the threshold being reached above.
-        if (curTime - pressStartTime <= UI_LONG_PRESS_TIME)
+        // Long, medium or short press? Only call for a medium or short press as
+        // long is called on the threshold being reached above.
+        uint32_t duration = curTime - pressStartTime;
+        if (duration > UI_LONG_PRESS_TIME)
+        {
+            // Long press, already handled.
+        }
+        else if (duration > UI_MEDIUM_PRESS_TIME)
+        {
+            // Medium press.
+            Serial.println(F("Medium press"));
+            btnMediumPress();
+        }
+        else
         {
             // Short press.
             Serial.println(F("Short press"));
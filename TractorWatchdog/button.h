@@ -12,7 +12,7 @@
 /**
  * @brief Class for handling input from a user facing button.
  * 
- * This class calls a function for a long and short press.
+ * This class calls a function for a long, medium and short press.
  * 
  */
 class Button
@@ -14,41 +14,96 @@
  */
 #include <Arduino.h>
 #include <Wire.h>
-#include <LiquidCrystal_I2C.h>
-#include <LCDGraph.h>
 #include <EEPROMWearLevel.h>
 
 /*
  * Constants
  */
 #define SERIAL_BAUD 38400
+#define SERIAL_DUMP_SPACE 50 // Free bytes needed in the serial transmit buffer to print the next line of a log.
+// #define LOOP_TIMING // Uncomment to print the free SRAM at startup and loop() times over serial, for comparing builds on the board.
+#define LOOP_TIMING_INTERVAL 10000 // ms between printing the mean and longest loop() times.
+
+// LCD
+#define LCD_ADDRESS 0x27
+#define LCD_ROWS 2
+#define LCD_COLS 16
+#define LCD_FLUSH_BUDGET 6 // Max bytes sent to the LCD per loop. 6 fit in a single I2C transaction (about 3ms).
 
 #define DEVICE_NAME F("Tractor Watchdog - Jotham Gates - 2023")
 #define DEVICE_URL F("github.com/jgOhYeah/TractorWatchdog")
 #define COMPILED_MSG F("Version " VERSION ". Compiled " __DATE__)
 
 #define GRAPH_PLOT_EVERY 9 // How many data points to average for each graph point.
-// 9 data points at 40 wide should be 20 minutes across the x axis.
+// 9 data points at 40 wide should be 6 minutes across the x axis.
+#define GRAPH_ZOOM_LEVELS 4 // Number of resolutions graph history is kept at.
+#define GRAPH_ZOOM_FACTORS {10, 6, 4} // Points from the level below in each point for each level after the first. 1h, 6h and 24h at 40 wide.
 #define UI_DEBOUNCE_TIME 10
+#define UI_MEDIUM_PRESS_TIME 1000
 #define UI_LONG_PRESS_TIME 5000
-#define RPM_DEBOUNCE_TIME 5 // Shouldn't need with the schmitt trigger input, but doesn't hurt to leave it in.
+#define RPM_DEBOUNCE_TIME 5 // us. Shouldn't need with the schmitt trigger input, but doesn't hurt to leave it in.
+#define RPM_TICKS_PER_US 2 // Timer1 runs at F_CPU / 8 for timing rotations.
+#define RPM_STOPPED_TIME 5000 // ms without a rotation before the engine is considered stopped.
+#define RPM_QUEUE_LENGTH 8 // Slots in the queue of periods from the ISR (holds one less).
+#define RPM_AVERAGE_REVS 8 // Number of revolutions to average the rpm over. A power of 2 so averaging is a shift.
+#define RPM_MEDIAN_OF 3 // Number of periods to take the median of to reject bad pulses (odd).
+#define RPM_MIN_PERIOD (60000000UL * RPM_TICKS_PER_US / LIMIT_REVS) // Shortest period allowed before over revving.
+#define RPM_OVERREV_PERIODS 3 // Consecutive short periods to stop the engine. More than a single bounce can cause.
+// #define RPM_INPUT_CAPTURE // Uncomment if the rpm sensor is wired to ICP1 (D8) instead of D2 (swapped with the oil switch).
 
 // Battery voltage voltage divider
 #define CAL_BATT_NUMERATOR 6950
 #define CAL_BATT_DENOMINATOR 39897
+#define POWER_FAIL_VOLTAGE 60 // Tenths of a volt. Below cranking dips, so only the ignition being turned off.
+#define POWER_RECOVER_VOLTAGE 80 // Tenths of a volt.
+#define POWER_FAIL_SAMPLES 32 // Battery samples in a row below POWER_FAIL_VOLTAGE to count as failing (about 3.5ms).
+
+#define DISPLAY_UPDATE_INTERVAL 1000 // ms between passing the state to the displays and graphs.
+#define SENSOR_PERIOD_OIL 5 // ms between readings of each sensor.
+#define SENSOR_PERIOD_RPM 50
+#define SENSOR_PERIOD_TEMPERATURE 250
+#define SENSOR_PERIOD_BATTERY 5000
+#define OIL_DEBOUNCE_COUNT 8 // Net samples in a row to change the oil pressure state (8 * 5ms = 40ms).
+#define OIL_START_GRACE 5000 // ms after the engine starts running before oil pressure is required.
+#define ADC_OVERSAMPLE 64 // Samples summed per channel. At most 64 so the sum fits in 16 bits.
+#define ADC_SETTLE_SAMPLES 1 // Samples discarded after changing channels.
 
-#define SENSOR_UPDATE_INTERVAL 1000
+// Thermistors
+#define THERMISTOR_BETA 3950.0
+#define THERMISTOR_R0 10000.0 // Resistance at THERMISTOR_T0.
+#define THERMISTOR_T0 25.0 // C
+#define THERMISTOR_SERIES_R 10000.0 // Resistor between the ADC pin and the reference.
+#define THERMISTOR_SEGMENT_BITS 6 // The lookup table has 2^bits segments.
+#define THERMISTOR_MIN_TEMP -40 // C. Readings are limited to this range.
+#define THERMISTOR_MAX_TEMP 150
+#define THERMISTOR_SHORT_READING 8 // ADC counts (of 1023). Readings below are a shorted thermistor.
+#define THERMISTOR_OPEN_READING 1015 // Readings above are an open thermistor or a broken wire.
 #define STARTUP_DELAY 5000
 
 // EEPROM settings
-#define EEPROM_LAYOUT_VERSION 0
+#define EEPROM_LAYOUT_VERSION 5 // Increase when the layout in store.cpp changes.
+#define LEGACY_LAYOUT_VERSION 0 // Of the old EEPROMWearLevel layout that hours are imported from.
 #define AMOUNT_OF_INDEXES 2
+#define STORE_MAX_RECORDS 6 // Entries in the EEPROM directory. Fixed so that adding records doesn't move the others.
+#define EEPROM_QUEUE_LENGTH 48 // Bytes of writes that can be waiting for the EEPROM.
+#define HOURS_JOURNAL_SLOTS 16 // Records to spread the hour counter writes over.
+#define HOURS_SAVE_INTERVAL 900000 // ms between saving the hours while running. Mainly saved on power failing.
+#define FAULT_LOG_ENTRIES 3 // Shutdowns to keep a record of.
+#define FAULT_SAMPLES 30 // Samples saved from before each shutdown.
+#define FAULT_SAMPLE_INTERVAL 2000 // ms between samples, so a minute of history is saved.
+#define TREND_BLOCKS 6 // Blocks in the trend log. The oldest is overwritten by each new one.
+#define TREND_BLOCK_LENGTH 80 // Bytes in each block of the trend log, including 17 bytes of header.
+#define TREND_SAMPLE_INTERVAL 1000 // ms between samples averaged into each minute of the trend log.
 
 
 /*
  * Limits
  */
 #define LIMIT_TEMPERATURE 110
+// Max C between the thermistors before warning. Only a warning (never a
+// shutdown), and off by default as a head and radiator thermistor routinely
+// differ by more than this while the thermostat is closed.
+// #define LIMIT_TEMPERATURE_DIFFERENCE 30
 #define LIMIT_REVS 1900
 
 /*
@@ -67,10 +122,16 @@
 #define PIN_RS485_DE 7
 
 // Sensors
+#ifdef RPM_INPUT_CAPTURE
+#define PIN_RPM 8 // ICP1
+#define PIN_OIL_SW 2
+#else
 #define PIN_RPM 2
 #define PIN_OIL_SW 8
+#endif
 #define PIN_THERMISTOR_1 A0
 #define PIN_THERMISTOR_2 A1
+#define TEMP_PROBE_2_FITTED // Comment out if there is no thermistor on PIN_THERMISTOR_2, so it isn't seen as failed.
 #define PIN_BATTERY A2
 
 // UI
@@ -9,13 +9,14 @@
 #include "display.h"
 
 extern State state;
+extern FaultRecorder faultRecorder;
 
 void Display::activate()
 {
     // Things that should happen for every display.
     lcd.clear();
     active = true;
-    drawState();
+    drawState(STATE_ALL);
 }
 
 void Display::deactivate()
@@ -62,42 +63,123 @@ void Display::drawTenths(const int16_t number, const uint8_t intDigits, const ch
     lcd.print(number % 10);
 }
 
-void DisplayIntervalTick::tick()
+void Display::drawDuration(const uint16_t minutes)
 {
-    if (active)
+    if (minutes < 60)
     {
-        uint32_t current = millis();
-        if (current - previous >= interval)
+        rightJustify(minutes, 2);
+        lcd.write('m');
+    }
+    else
+    {
+        rightJustify(minutes / 60, 2);
+        lcd.write('h');
+    }
+}
+
+void DisplayScheduler::run()
+{
+    uint32_t now = millis();
+    while (count && (int32_t)(now - entries[0].time) >= 0)
+    {
+        // Remove before waking so the display can reschedule itself.
+        Display *display = entries[0].display;
+        count--;
+        memmove(entries, entries + 1, count * sizeof(Entry));
+        display->wake(now);
+    }
+}
+
+void DisplayScheduler::schedule(Display *display, uint32_t time)
+{
+    cancel(display);
+    if (count >= MAX_ENTRIES)
+    {
+        // Shouldn't happen as there aren't this many displays.
+        Serial.println(F("Display scheduler full"));
+        return;
+    }
+
+    // Find where to insert to keep the list in order. Compare differences so
+    // this still works when millis() overflows.
+    uint8_t i = count;
+    while (i && (int32_t)(time - entries[i - 1].time) < 0)
+    {
+        entries[i] = entries[i - 1];
+        i--;
+    }
+    entries[i].time = time;
+    entries[i].display = display;
+    count++;
+}
+
+void DisplayScheduler::cancel(Display *display)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (entries[i].display == display)
         {
-            previous = current;
-            intervalTick();
+            count--;
+            memmove(entries + i, entries + i + 1, (count - i) * sizeof(Entry));
+            return;
         }
     }
 }
 
+void DisplayIntervalTick::wake(uint32_t now)
+{
+    scheduler.schedule(this, now + interval);
+    intervalTick();
+}
+
 void DisplayIntervalTick::activate()
 {
     Display::activate();
-    previous = millis() - interval; // Reset the interval to start now.
+    scheduler.schedule(this, millis()); // Reset the interval to start now.
+}
+
+void DisplayIntervalTick::deactivate()
+{
+    Display::deactivate();
+    scheduler.cancel(this);
 }
 
 void DisplayAbout::activate()
 {
+    // The first interval tick happens straight away and will scroll to the
+    // start.
+    scroll = LINE_LENGTH - SCROLL_STEP;
     DisplayIntervalTick::activate();
+}
+
+void DisplayAbout::drawState(uint8_t changed)
+{
     // Top row
     lcd.setCursor(0, 0);
-    lcd.print(DEVICE_NAME);
+    drawScrolled(DEVICE_NAME, 0);
 
     // Bottom row
-    lcd.setCursor(4, 1);
-    lcd.print(DEVICE_URL);
+    lcd.setCursor(0, 1);
+    drawScrolled(DEVICE_URL, 4);
+}
 
-    // Dodgy offset the display so that the first scroll puts it in the correct
-    // starting position. // TODO: Fix
-    lcd.scrollDisplayRight();
-    lcd.scrollDisplayRight();
-    lcd.scrollDisplayRight();
-    lcd.scrollDisplayRight();
+void DisplayAbout::drawScrolled(const __FlashStringHelper *text, const uint8_t start)
+{
+    PGM_P chars = reinterpret_cast<PGM_P>(text);
+    uint8_t length = strlen_P(chars);
+    for (uint8_t col = 0; col < LCD_COLS; col++)
+    {
+        // Work out which character in the line would be shown in this column.
+        uint8_t position = (scroll + col) % LINE_LENGTH;
+        if (position >= start && position - start < length)
+        {
+            lcd.write(pgm_read_byte(chars + position - start));
+        }
+        else
+        {
+            lcd.write(' ');
+        }
+    }
 }
 
 void DisplayHome::activate()
@@ -120,106 +202,64 @@ void DisplayHome::activate()
     lcd.write('h');
 }
 
-void DisplayHome::drawState()
+void DisplayHome::drawState(uint8_t changed)
 {
     // Engine status
     // The length of each string must be the same so that the remains of the
     // previous isn't left behind.
-    lcd.setCursor(0, 0);
-    switch (state.engineState)
+    if (changed & STATE_ENGINE)
     {
-    case RUNNING:
-        lcd.print(F("Running  "));
-        break;
-    case STOPPED:
-        lcd.print(F("Stopped  "));
-        break;
-    default:
-        lcd.print(F("SHUTDOWN "));
+        lcd.setCursor(0, 0);
+        switch (state.engineState)
+        {
+        case RUNNING:
+            lcd.print(F("Running  "));
+            break;
+        case STOPPED:
+            lcd.print(F("Stopped  "));
+            break;
+        default:
+            lcd.print(F("SHUTDOWN "));
+        }
     }
 
     // RPM
-    lcd.setCursor(9, 0);
-    rightJustify(state.rpm, 4);
+    if (changed & STATE_RPM)
+    {
+        lcd.setCursor(9, 0);
+        rightJustify(state.rpm, 4);
+    }
 
     // Battery voltage.
-    lcd.setCursor(0, 1);
-    drawTenths(state.voltage, 2);
-
-    // Temperature
-    lcd.setCursor(5, 1);
-    rightJustify(state.temperature, 3);
-
-    // Trip hours
-    lcd.setCursor(10, 1);
-    uint32_t hourTenths = (state.tripMinutes / 60) * 10; // Add the hours.
-    hourTenths += ((state.tripMinutes % 60) * 10) / 60;  // Add the minutes as tenths of an hour.
-    drawTenths(hourTenths, 3);
-}
-
-void DisplayAbout::intervalTick()
-{
-    // The white on blue LCDs don't have the best update rate, so do fewer, larger jumps.
-    lcd.scrollDisplayLeft();
-    lcd.scrollDisplayLeft();
-    lcd.scrollDisplayLeft();
-    lcd.scrollDisplayLeft();
-}
-
-Graph::Graph(LiquidCrystal_I2C &lcd, uint8_t graphWidth) : lcd(lcd), graph(graphWidth, 0)
-{
-    // Mose well call begin in the constructor as only setting variables.
-    graph.begin(&lcd);
-    graph.filled = false;
-}
-
-void Graph::addData(int16_t data)
-{
-    lastPointAccumulator += data;
-    lastPoints++;
-
-    // Set max and mins
-    if (graph.length())
+    if (changed & STATE_VOLTAGE)
     {
-        // There is data in the graph.
-        if (data < graph.yMin)
-        {
-            graph.yMin = data;
-        }
-        if (data > graph.yMax)
-        {
-            graph.yMax = data;
-        }
+        lcd.setCursor(0, 1);
+        drawTenths(state.voltage, 2);
     }
-    else
+
+    // Temperature
+    if (changed & STATE_TEMPERATURE)
     {
-        // No data in the graph. This is the new max and min.
-        graph.yMax = data;
-        graph.yMin = data;
+        lcd.setCursor(5, 1);
+        rightJustify(state.temperature, 3);
+        lcd.setCursor(9, 1);
+        lcd.write(state.thermistorsDisagree || state.probeWarning ? '!' : ' '); // Warning only.
     }
 
-    // If we have enough points, plot.
-    if (lastPoints >= GRAPH_PLOT_EVERY)
+    // Trip hours
+    if (changed & STATE_TRIP)
     {
-        addAveragePoint();
+        lcd.setCursor(10, 1);
+        uint32_t hourTenths = (state.tripMinutes / 60) * 10; // Add the hours.
+        hourTenths += ((state.tripMinutes % 60) * 10) / 60;  // Add the minutes as tenths of an hour.
+        drawTenths(hourTenths, 3);
     }
 }
 
-void Graph::addAveragePoint()
-{
-    graph.add(lastPointAccumulator / lastPoints);
-    lastPointAccumulator = 0;
-    lastPoints = 0;
-}
-
-void Graph::setRegisters()
-{
-    graph.setRegisters();
-}
-
-void Graph::display()
+void DisplayAbout::intervalTick()
 {
-    graph.display(0, 1);
+    scroll = (scroll + SCROLL_STEP) % LINE_LENGTH;
+    drawState(STATE_ALL);
 }
 
 void DisplayWaterTemp::activate()
@@ -227,14 +267,14 @@ void DisplayWaterTemp::activate()
     Display::activate();
     // Title
     lcd.setCursor(0, 0);
-    lcd.print(F("Water Temp"));
+    lcd.print(F("Water"));
 
     // Current temperature
     lcd.setCursor(15, 0);
     lcd.write('C');
 
-    // LCDGraph
-    graph.setRegisters();
+    // Graph. The other graph might have been using the custom characters.
+    graph.setRegisters(true);
     graph.display();
 
     // Max temperature
@@ -246,21 +286,34 @@ void DisplayWaterTemp::activate()
 
 void DisplayWaterTemp::updateData()
 {
-    graph.addData(state.temperature);
+    graph.addData(constrain(state.temperature, 0, 255));
 }
 
-void DisplayWaterTemp::drawState()
+void DisplayWaterTemp::drawState(uint8_t changed)
 {
     // Current temperature
-    lcd.setCursor(12, 0);
-    rightJustify(state.temperature, 3);
+    if (changed & STATE_TEMPERATURE)
+    {
+        lcd.setCursor(12, 0);
+        rightJustify(state.temperature, 3);
+    }
 
+    // The graph and max can change even if the temperature hasn't as old data
+    // scrolls off, so always redraw. Nothing will be sent if it is the same.
     // Graph (display has already been called).
     graph.setRegisters();
+    lcd.setCursor(6, 0);
+    drawDuration(graph.spanMinutes());
 
     // Max temperature
     lcd.setCursor(12, 1);
-    rightJustify(graph.graph.yMax, 3);
+    rightJustify(graph.yMax, 3);
+}
+
+void DisplayWaterTemp::zoom()
+{
+    graph.zoom();
+    drawState(0);
 }
 
 void DisplayVoltage::activate()
@@ -274,8 +327,8 @@ void DisplayVoltage::activate()
     lcd.setCursor(15, 0);
     lcd.write('V');
 
-    // LCDGraph
-    graph.setRegisters();
+    // Graph. The other graph might have been using the custom characters.
+    graph.setRegisters(true);
     graph.display();
 
     // Max and min voltage
@@ -288,14 +341,21 @@ void DisplayVoltage::updateData()
     graph.addData(state.voltage);
 }
 
-void DisplayVoltage::drawState()
+void DisplayVoltage::drawState(uint8_t changed)
 {
-    // Current temperature
-    lcd.setCursor(11, 0);
-    drawTenths(state.voltage, 2);
+    // Current voltage
+    if (changed & STATE_VOLTAGE)
+    {
+        lcd.setCursor(11, 0);
+        drawTenths(state.voltage, 2);
+    }
 
+    // The graph, max and min can change even if the voltage hasn't as old data
+    // scrolls off, so always redraw. Nothing will be sent if it is the same.
     // Graph (display has already been called).
     graph.setRegisters();
+    lcd.setCursor(7, 0);
+    drawDuration(graph.spanMinutes());
 
     // Max and min temperature
     lcd.setCursor(7, 1);
@@ -303,20 +363,26 @@ void DisplayVoltage::drawState()
     {
         // Draw the maximum temperature.
         lcd.print(F("Max "));
-        drawTenths(graph.graph.yMax, 2);
+        drawTenths(graph.yMax, 2);
     }
     else
     {
         // Draw the minimum temperature.
         lcd.print(F("Min "));
-        drawTenths(graph.graph.yMin, 2);
+        drawTenths(graph.yMin, 2);
     }
 }
 
+void DisplayVoltage::zoom()
+{
+    graph.zoom();
+    drawState(0);
+}
+
 void DisplayVoltage::intervalTick()
 {
     maxShown = !maxShown;
-    drawState();
+    drawState(0);
 }
 
 void DisplayError::activate()
@@ -327,8 +393,13 @@ void DisplayError::activate()
     lcd.print(F("ENGINE SHUTDOWN!"));
 }
 
-void DisplayError::drawState()
+void DisplayError::drawState(uint8_t changed)
 {
+    if (!(changed & STATE_ENGINE))
+    {
+        return;
+    }
+
     lcd.setCursor(0, 1);
     switch (state.engineState)
     {
@@ -346,6 +417,9 @@ void DisplayError::drawState()
     case OIL_PRESSURE:
         lcd.print(F("No oil pressure!"));
         break;
+    case TEMP_PROBE:
+        lcd.print(F("Temp sensor fail"));
+        break;
     default:
         // In case an extra error state is added but not entered here.
         lcd.print(F("Something else"));
@@ -394,15 +468,15 @@ void DisplayErrorAlternating::intervalTick()
     showingHome = !showingHome;
 }
 
-void DisplayErrorAlternating::drawState()
+void DisplayErrorAlternating::drawState(uint8_t changed)
 {
     if (showingHome)
     {
-        home.drawState();
+        home.drawState(changed);
     }
     else
     {
-        error.drawState();
+        error.drawState(changed);
     }
 }
 
@@ -426,33 +500,85 @@ void DisplayTime::activate()
     lcd.write('m');
 }
 
-void DisplayTime::drawState()
+void DisplayTime::drawState(uint8_t changed)
 {
     const char NUMBER_PREFIX = ' ';
     // Total
-    uint32_t hours = state.totalMinutes / 60;
-    uint32_t minutes = state.totalMinutes % 60;
-    lcd.setCursor(7, 0);
-    rightJustify(hours, 4, NUMBER_PREFIX);
-    lcd.setCursor(13, 0);
-    rightJustify(minutes, 2, NUMBER_PREFIX);
+    if (changed & STATE_TOTAL)
+    {
+        uint32_t hours = state.totalMinutes / 60;
+        uint32_t minutes = state.totalMinutes % 60;
+        lcd.setCursor(7, 0);
+        rightJustify(hours, 4, NUMBER_PREFIX);
+        lcd.setCursor(13, 0);
+        rightJustify(minutes, 2, NUMBER_PREFIX);
+    }
 
     // Trip
-    hours = state.tripMinutes / 60;
-    minutes = state.tripMinutes % 60;
-    lcd.setCursor(7, 1);
-    rightJustify(hours, 4, NUMBER_PREFIX);
-    lcd.setCursor(13, 1);
-    rightJustify(minutes, 2, NUMBER_PREFIX);
+    if (changed & STATE_TRIP)
+    {
+        uint32_t hours = state.tripMinutes / 60;
+        uint32_t minutes = state.tripMinutes % 60;
+        lcd.setCursor(7, 1);
+        rightJustify(hours, 4, NUMBER_PREFIX);
+        lcd.setCursor(13, 1);
+        rightJustify(minutes, 2, NUMBER_PREFIX);
+    }
 }
 
-void DisplayManager::tick()
+void DisplayFaults::activate()
 {
-    const uint8_t DISPLAY_COUNT = sizeof(displays) / sizeof(Display *);
-    for (uint8_t i = 0; i < DISPLAY_COUNT; i++)
+    index = 0;
+    draw();
+}
+
+void DisplayFaults::zoom()
+{
+    index++;
+    draw();
+}
+
+void DisplayFaults::draw()
+{
+    FaultSummary summary;
+    if (!faultRecorder.read(index, summary))
     {
-        displays[i]->tick();
+        // Past the oldest. Go back to the newest.
+        index = 0;
+        if (!faultRecorder.read(index, summary))
+        {
+            Display::activate();
+            lcd.setCursor(0, 0);
+            lcd.print(F("No faults saved"));
+            return;
+        }
     }
+
+    // Fault and engine hours.
+    Display::activate();
+    lcd.setCursor(0, 0);
+    lcd.print(index + 1);
+    lcd.setCursor(2, 0);
+    FaultRecorder::printFault(lcd, summary.fault);
+    lcd.setCursor(11, 0);
+    rightJustify(summary.totalMinutes / 60, 4);
+    lcd.write('h');
+
+    // Readings at the time.
+    lcd.setCursor(0, 1);
+    rightJustify(summary.last.temperature(), 3);
+    lcd.write('C');
+    lcd.setCursor(5, 1);
+    drawTenths(summary.last.voltage(), 2);
+    lcd.write('V');
+    lcd.setCursor(11, 1);
+    rightJustify(summary.last.rpm(), 4);
+    lcd.write('r');
+}
+
+void DisplayManager::tick()
+{
+    scheduler.run();
 }
 
 void DisplayManager::next()
@@ -493,18 +619,28 @@ void DisplayManager::activate(DisplayIndex next)
     displays[currentIndex]->activate();
 }
 
+void DisplayManager::zoom()
+{
+    if (currentIndex != DISP_INVALID_INDEX)
+    {
+        displays[currentIndex]->zoom();
+    }
+}
+
 void DisplayManager::updateState()
 {
-    // Call updateData for each data point.
+    // Call updateData for each data point. The graphs need every reading,
+    // even if it is the same as the last.
     const uint8_t DISPLAY_COUNT = sizeof(displays) / sizeof(Display *);
     for (uint8_t i = 0; i < DISPLAY_COUNT; i++)
     {
         displays[i]->updateData();
     }
 
-    // For the active display, call its function to draw the new data.
+    // For the active display, call its function to draw what changed.
+    uint8_t changed = state.takeChanges();
     if (currentIndex != DISP_INVALID_INDEX)
     {
-        displays[currentIndex]->drawState();
+        displays[currentIndex]->drawState(changed);
     }
 }
\ No newline at end of file
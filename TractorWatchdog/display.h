@@ -9,6 +9,9 @@
 #pragma once
 #include "defines.h"
 #include "state.h"
+#include "lcdbuffer.h"
+#include "graph.h"
+#include "faults.h"
 
 /**
  * @brief Base class for each window that is displayed on the LCD.
@@ -22,13 +25,15 @@ public:
      *
      * @param lcd reference to the LCD to use.
      */
-    Display(LiquidCrystal_I2C &lcd) : lcd(lcd){};
+    Display(LCDBuffer &lcd) : lcd(lcd){};
 
     /**
-     * @brief Called regularly, even when the display is not currently activated.
+     * @brief Called by the DisplayScheduler once the time the display asked to
+     * be woken at has come.
      *
+     * @param now the current time in ms.
      */
-    virtual void tick(){};
+    virtual void wake(uint32_t now){};
 
     /**
      * @brief Draws the display as the current one on the screen.
@@ -47,9 +52,13 @@ public:
      * @brief Called whenever data that the system might have on the screen is
      * updated. Also called upon activating the state.
      *
-     * @param state the new data.
+     * Only the parts of the screen showing fields that have changed need to be
+     * redrawn.
+     *
+     * @param changed bitmask of StateFields that changed (STATE_ALL when
+     *                activating).
      */
-    virtual void drawState(){};
+    virtual void drawState(uint8_t changed){};
 
     /**
      * @brief Called whenever there is a new state available.
@@ -57,6 +66,13 @@ public:
      */
     virtual void updateData(){};
 
+    /**
+     * @brief Called when the user asks to zoom (medium button press) while
+     * this display is active.
+     *
+     */
+    virtual void zoom(){};
+
     bool active;
 
 protected:
@@ -81,7 +97,63 @@ protected:
      */
     void drawTenths(const int16_t number, const uint8_t intDigits, const char padding = ' ');
 
-    LiquidCrystal_I2C &lcd;
+    /**
+     * @brief Prints a duration in 3 characters as minutes or hours, such as
+     * " 6m" or "24h".
+     *
+     * @param minutes the duration in minutes.
+     */
+    void drawDuration(const uint16_t minutes);
+
+    LCDBuffer &lcd;
+};
+
+/**
+ * @brief Keeps a list of displays that want to be woken up, sorted by when.
+ *
+ * Checking if anything is due only needs to look at the start of the list, so
+ * a loop where nothing needs to happen is a single comparison.
+ *
+ */
+class DisplayScheduler
+{
+public:
+    /**
+     * @brief Wakes any displays that are due.
+     *
+     */
+    void run();
+
+    /**
+     * @brief Asks for a display to be woken at a given time. Replaces any time
+     * already requested for the display.
+     *
+     * @param display the display to wake.
+     * @param time the time in ms (from millis()) to wake it at.
+     */
+    void schedule(Display *display, uint32_t time);
+
+    /**
+     * @brief Removes a display from the list if it is in it.
+     *
+     * @param display the display.
+     */
+    void cancel(Display *display);
+
+private:
+    /**
+     * @brief A display and when to wake it.
+     *
+     */
+    struct Entry
+    {
+        uint32_t time;
+        Display *display;
+    };
+
+    static const uint8_t MAX_ENTRIES = 8;
+    Entry entries[MAX_ENTRIES];
+    uint8_t count = 0;
 };
 
 /**
@@ -96,16 +168,18 @@ public:
      * @brief Construct a new Display Interval Tick object
      *
      * @param lcd the lcd to write to.
+     * @param scheduler the scheduler to wake this display.
      * @param interval the tick interval in ms.
      */
-    DisplayIntervalTick(LiquidCrystal_I2C &lcd, const uint32_t interval) : Display::Display(lcd), interval(interval) {}
+    DisplayIntervalTick(LCDBuffer &lcd, DisplayScheduler &scheduler, const uint32_t interval)
+        : Display::Display(lcd), scheduler(scheduler), interval(interval) {}
 
     /**
-     * @brief Checks if the interval has ellapsed and calls intervalTick if it
-     * has.
+     * @brief Calls intervalTick and schedules the next one.
      *
+     * @param now the current time in ms.
      */
-    virtual void tick();
+    virtual void wake(uint32_t now);
 
     /**
      * @brief Draws the display as the current one on the screen.
@@ -113,6 +187,12 @@ public:
      */
     virtual void activate();
 
+    /**
+     * @brief Stops the interval ticks.
+     *
+     */
+    virtual void deactivate();
+
 protected:
     /**
      * @brief Method that is called on the interval tick.
@@ -121,7 +201,7 @@ protected:
     virtual void intervalTick() {}
 
 private:
-    uint32_t previous = 0;
+    DisplayScheduler &scheduler;
     const uint32_t interval;
 };
 
@@ -132,7 +212,7 @@ private:
 class DisplayAbout : public DisplayIntervalTick
 {
 public:
-    DisplayAbout(LiquidCrystal_I2C &lcd) : DisplayIntervalTick(lcd, 1000) {}
+    DisplayAbout(LCDBuffer &lcd, DisplayScheduler &scheduler) : DisplayIntervalTick(lcd, scheduler, 1000) {}
 
     /**
      * @brief Draws the display as the current one on the screen.
@@ -140,11 +220,35 @@ public:
      */
     virtual void activate();
 
+    /**
+     * @brief Draws the visible part of the scrolling text.
+     *
+     */
+    virtual void drawState(uint8_t changed);
+
     /**
      * @brief Called regularly to scroll.
      *
      */
     virtual void intervalTick();
+
+private:
+    /**
+     * @brief Draws the part of a line of text that is currently visible.
+     *
+     * The text wraps around a line the same length as the LCD's memory so that
+     * it scrolls the same way as the LCD's built in scrolling would.
+     *
+     * @param text the text to draw.
+     * @param start the position of the first character in the line.
+     */
+    void drawScrolled(const __FlashStringHelper *text, const uint8_t start);
+
+    // Length of a line in the LCD's memory, which the text wraps around.
+    static const uint8_t LINE_LENGTH = 40;
+    // The white on blue LCDs don't have the best update rate, so do fewer, larger jumps.
+    static const uint8_t SCROLL_STEP = 4;
+    uint8_t scroll;
 };
 
 /**
@@ -167,55 +271,7 @@ public:
      * updated.
      *
      */
-    virtual void drawState();
-};
-
-/**
- * @brief Base class for displays with a graph.
- *
- */
-class Graph
-{
-public:
-    Graph(LiquidCrystal_I2C &lcd, uint8_t graphWidth);
-
-    /**
-     * @brief Adds a datapoint to be averaged. The max and min is also set using
-     * these.
-     *
-     * If there are more than GRAPH_PLOT_EVERY points, then add to the graph.
-     *
-     * @param data the point to add.
-     */
-    void addData(int16_t data);
-
-    /**
-     * @brief Sets the registers and draws the graph on the screen.
-     *
-     */
-    void setRegisters();
-
-    /**
-     * @brief Draws the graph in the bottom left corner.
-     *
-     * @code setRegisters() @endcode needs to be called separetely.
-     *
-     */
-    void display();
-
-    LCDGraph<int16_t, LiquidCrystal_I2C> graph;
-
-protected:
-    /**
-     * @brief Averages the points since this was last called and adds this to
-     * the graph.
-     *
-     */
-    void addAveragePoint();
-
-    LiquidCrystal_I2C &lcd;
-    int32_t lastPointAccumulator = 0;
-    uint16_t lastPoints = 0;
+    virtual void drawState(uint8_t changed);
 };
 
 /**
@@ -225,7 +281,7 @@ protected:
 class DisplayWaterTemp : public Display
 {
 public:
-    DisplayWaterTemp(LiquidCrystal_I2C &lcd) : Display(lcd), graph(lcd, 8) {}
+    DisplayWaterTemp(LCDBuffer &lcd) : Display(lcd), graph(lcd) {}
 
     /**
      * @brief Draws the display as the current one on the screen.
@@ -246,11 +302,17 @@ public:
      * updated.
      *
      */
-    virtual void drawState();
+    virtual void drawState(uint8_t changed);
+
+    /**
+     * @brief Shows the graph at the next zoom level.
+     *
+     */
+    virtual void zoom();
 
 private:
     bool maxShown = true;
-    Graph graph;
+    Graph<uint8_t, 8, GRAPH_PLOT_EVERY> graph; // Temperatures below 0C are shown as 0.
 };
 
 /**
@@ -260,7 +322,7 @@ private:
 class DisplayVoltage : public DisplayIntervalTick
 {
 public:
-    DisplayVoltage(LiquidCrystal_I2C &lcd) : DisplayIntervalTick(lcd, 4000), graph(lcd, 6) {}
+    DisplayVoltage(LCDBuffer &lcd, DisplayScheduler &scheduler) : DisplayIntervalTick(lcd, scheduler, 4000), graph(lcd) {}
 
     /**
      * @brief Draws the display as the current one on the screen.
@@ -281,7 +343,13 @@ public:
      * updated.
      *
      */
-    virtual void drawState();
+    virtual void drawState(uint8_t changed);
+
+    /**
+     * @brief Shows the graph at the next zoom level.
+     *
+     */
+    virtual void zoom();
 
     /**
      * @brief Method that is called on the interval tick.
@@ -293,7 +361,7 @@ public:
 
 private:
     bool maxShown = true;
-    Graph graph;
+    Graph<uint8_t, 6, GRAPH_PLOT_EVERY> graph; // Tenths of a volt.
 };
 
 /**
@@ -316,7 +384,7 @@ public:
      * updated.
      *
      */
-    virtual void drawState();
+    virtual void drawState(uint8_t changed);
 };
 
 /**
@@ -327,8 +395,8 @@ class DisplayErrorAlternating : public DisplayIntervalTick
 {
 public:
     DisplayErrorAlternating(
-        LiquidCrystal_I2C &lcd, DisplayError &dispErr, DisplayHome &dispHome)
-        : DisplayIntervalTick(lcd, 2000), error(dispErr), home(dispHome){};
+        LCDBuffer &lcd, DisplayScheduler &scheduler, DisplayError &dispErr, DisplayHome &dispHome)
+        : DisplayIntervalTick(lcd, scheduler, 2000), error(dispErr), home(dispHome){};
 
     /**
      * @brief Activates the error display first.
@@ -346,7 +414,7 @@ public:
      * @brief Calls drawState for the currently active display.
      * 
      */
-    virtual void drawState();
+    virtual void drawState(uint8_t changed);
 
 protected:
     /**
@@ -381,7 +449,39 @@ public:
      * updated.
      *
      */
-    virtual void drawState();
+    virtual void drawState(uint8_t changed);
+};
+
+/**
+ * @brief Display that shows the faults saved in EEPROM, newest first.
+ *
+ */
+class DisplayFaults : public Display
+{
+public:
+    using Display::Display;
+
+    /**
+     * @brief Draws the newest fault.
+     *
+     */
+    virtual void activate();
+
+    /**
+     * @brief Shows the next older fault, going back to the newest after the
+     * oldest.
+     *
+     */
+    virtual void zoom();
+
+private:
+    /**
+     * @brief Draws the fault at index.
+     *
+     */
+    void draw();
+
+    uint8_t index;
 };
 
 /**
@@ -394,6 +494,7 @@ enum DisplayIndex
     DISP_TEMPERATURE,
     DISP_VOLTAGE,
     DISP_TIME,
+    DISP_FAULTS,
     DISP_ABOUT,
     DISP_ERROR_SINGLE,
     DISP_ERROR,
@@ -408,12 +509,12 @@ enum DisplayIndex
 class DisplayManager
 {
 public:
-    DisplayManager(LiquidCrystal_I2C &lcd)
-        : about(lcd), temp(lcd), voltage(lcd), home(lcd), time(lcd),
-          errorSingle(lcd), error(lcd, errorSingle, home){};
+    DisplayManager(LCDBuffer &lcd)
+        : about(lcd, scheduler), temp(lcd), voltage(lcd, scheduler), home(lcd), time(lcd),
+          faults(lcd), errorSingle(lcd), error(lcd, scheduler, errorSingle, home){};
 
     /**
-     * @brief Calls the tick function for each display.
+     * @brief Wakes any displays that asked to be woken by now.
      *
      */
     void tick();
@@ -433,6 +534,12 @@ public:
      */
     void activate(DisplayIndex next);
 
+    /**
+     * @brief Passes a zoom request on to the current display.
+     *
+     */
+    void zoom();
+
     /**
      * @brief Called to update data from the current state.
      *
@@ -447,14 +554,16 @@ public:
     uint8_t currentIndex = DISP_INVALID_INDEX;
 
 private:
+    DisplayScheduler scheduler; // Needs to be constructed before the displays.
     DisplayAbout about;
     DisplayWaterTemp temp;
     DisplayHome home;
     DisplayVoltage voltage;
     DisplayTime time;
+    DisplayFaults faults;
     DisplayError errorSingle;
     DisplayErrorAlternating error;
 
-    Display *const displays[8] = {&home, &temp, &voltage, &time, &about, &errorSingle, &error, &time};
-    const int8_t VIEWABLE_DISPLAYS = 5; // When the display is not one on the viewable list.
+    Display *const displays[9] = {&home, &temp, &voltage, &time, &faults, &about, &errorSingle, &error, &time};
+    const int8_t VIEWABLE_DISPLAYS = 6; // When the display is not one on the viewable list.
 };
\ No newline at end of file
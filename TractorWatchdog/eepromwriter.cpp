@@ -0,0 +1,97 @@
+/**
+ * @file eepromwriter.cpp
+ * @brief Writes to EEPROM in the background from the EEPROM ready interrupt.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-24
+ */
+#include "eepromwriter.h"
+
+bool EepromWriter::write(const uint16_t address, const void *data, const uint8_t length)
+{
+    // One slot is always left empty to tell full from empty.
+    if (used() + HEADER_LENGTH + length >= EEPROM_QUEUE_LENGTH)
+    {
+        return false;
+    }
+
+    uint8_t index = head;
+    const uint8_t header[HEADER_LENGTH] = {length, (uint8_t)address, (uint8_t)(address >> 8)};
+    for (uint8_t i = 0; i < HEADER_LENGTH + length; i++)
+    {
+        queue[index] = i < HEADER_LENGTH ? header[i] : ((const uint8_t *)data)[i - HEADER_LENGTH];
+        index = (index + 1) % EEPROM_QUEUE_LENGTH;
+    }
+    asm volatile("" ::: "memory"); // Write the data before publishing it.
+    head = index;
+
+    // The interrupt fires whenever the EEPROM is ready, so enabling it starts
+    // the writes.
+    EECR |= _BV(EERIE);
+    return true;
+}
+
+uint8_t EepromWriter::read(const uint16_t address)
+{
+    // Wait for any write to finish with interrupts off, so the ISR can't
+    // start another before the registers have been used.
+    while (true)
+    {
+        noInterrupts();
+        if (!(EECR & _BV(EEPE)))
+        {
+            break;
+        }
+        interrupts();
+    }
+    EEAR = address;
+    EECR |= _BV(EERE);
+    uint8_t value = EEDR;
+    interrupts();
+    return value;
+}
+
+void EepromWriter::ready()
+{
+    while (true)
+    {
+        if (!active)
+        {
+            if (head == tail)
+            {
+                // Nothing left to do.
+                EECR &= ~_BV(EERIE);
+                return;
+            }
+
+            // Start the next write.
+            remaining = peek(0);
+            address = peek(1) | (uint16_t)peek(2) << 8;
+            tail = (tail + HEADER_LENGTH) % EEPROM_QUEUE_LENGTH;
+            active = true;
+        }
+
+        if (!remaining)
+        {
+            active = false;
+            continue;
+        }
+
+        uint8_t value = peek(0);
+        tail = (tail + 1) % EEPROM_QUEUE_LENGTH;
+        remaining--;
+        uint16_t current = address++;
+
+        // Skip bytes that are already correct.
+        EEAR = current;
+        EECR |= _BV(EERE);
+        if (EEDR != value)
+        {
+            EEDR = value;
+            EECR |= _BV(EEMPE);
+            EECR |= _BV(EEPE);
+            return; // The interrupt fires again once this is done.
+        }
+    }
+}
@@ -0,0 +1,101 @@
+/**
+ * @file eepromwriter.h
+ * @brief Writes to EEPROM in the background from the EEPROM ready interrupt.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-24
+ */
+#pragma once
+#include "defines.h"
+
+/**
+ * @brief Queues writes to EEPROM and performs them a byte at a time from the
+ * EEPROM ready interrupt, so that the main loop never waits ~3.4ms per byte.
+ *
+ * Bytes that already have the right value are skipped to save time and wear.
+ *
+ */
+class EepromWriter
+{
+public:
+    /**
+     * @brief Queues bytes to be written.
+     *
+     * @param address the EEPROM address to start at.
+     * @param data the bytes to write. These are copied.
+     * @param length the number of bytes.
+     * @return true if the bytes were queued.
+     * @return false if there isn't room in the queue. Nothing is queued.
+     */
+    bool write(const uint16_t address, const void *data, const uint8_t length);
+
+    /**
+     * @brief Checks if there are writes that haven't finished.
+     *
+     */
+    bool busy() const { return head != tail || active; }
+
+    /**
+     * @brief Reads a byte without upsetting a write the ISR is doing.
+     *
+     * The ISR uses the address and data registers too, so reading with
+     * EEPROM.read() while it is busy can return the wrong byte or write to
+     * the wrong address. Anything reading EEPROM while the writer might be
+     * in use must read through this.
+     *
+     * Queued writes that haven't been done yet aren't seen.
+     *
+     * @param address the address to read.
+     * @return uint8_t the byte.
+     */
+    static uint8_t read(const uint16_t address);
+
+    /**
+     * @brief Reads an object using read().
+     *
+     * @param address the address of the first byte.
+     * @param value where to put the object.
+     * @return T& value.
+     */
+    template <typename T>
+    static T &get(const uint16_t address, T &value)
+    {
+        uint8_t *bytes = (uint8_t *)&value;
+        for (uint8_t i = 0; i < sizeof(T); i++)
+        {
+            bytes[i] = read(address + i);
+        }
+        return value;
+    }
+
+    /**
+     * @brief Call from the EEPROM ready ISR.
+     *
+     */
+    void ready();
+
+private:
+    /**
+     * @brief Reads the byte at a position in the queue.
+     *
+     */
+    uint8_t peek(const uint8_t offset) const { return queue[(uint8_t)(tail + offset) % EEPROM_QUEUE_LENGTH]; }
+
+    /**
+     * @brief Number of bytes in the queue.
+     *
+     */
+    uint8_t used() const { return (uint8_t)(head + EEPROM_QUEUE_LENGTH - tail) % EEPROM_QUEUE_LENGTH; }
+
+    // Writes are stored as the length, address (low byte first) and data.
+    static const uint8_t HEADER_LENGTH = 3;
+    uint8_t queue[EEPROM_QUEUE_LENGTH];
+    volatile uint8_t head = 0; // Only changed by write().
+    volatile uint8_t tail = 0; // Only changed by ready().
+
+    // The write being done. Only used by ready().
+    volatile bool active = false;
+    uint16_t address;
+    uint8_t remaining;
+};
@@ -0,0 +1,278 @@
+/**
+ * @file faults.cpp
+ * @brief Black box recorder that saves what led up to each shutdown.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-26
+ */
+#include "faults.h"
+#include <util/crc16.h>
+
+extern State state;
+
+// Bytes to queue at a time when saving, so others can use the writer too.
+#define FAULT_CHUNK_LENGTH 16
+
+static_assert(sizeof(FaultEntry) <= 255, "The saved byte count must fit in a uint8_t.");
+
+void FaultSample::pack(const State &state)
+{
+    bytes[0] = constrain(state.temperature, 0, 255);
+    bytes[1] = constrain((state.voltage - 60) / 2, 0, 0x3f) | (state.oilPressure ? 0x40 : 0) | (state.oilExpected ? 0x80 : 0);
+    bytes[2] = min(state.rpm / 32, 0x7f) | (state.engineState == RUNNING ? 0x80 : 0);
+}
+
+void FaultRecorder::begin(const uint16_t address, const uint8_t seed)
+{
+    startAddress = address;
+    crcSeed = seed;
+
+    // Find the newest entry so the next is written after it.
+    bool found = false;
+    for (uint8_t i = 0; i < FAULT_LOG_ENTRIES; i++)
+    {
+        EepromWriter::get(slotAddress(i), entry);
+        if (entry.crc == crc(entry) && (!found || (int16_t)(entry.sequence - sequence) > 0))
+        {
+            found = true;
+            sequence = entry.sequence;
+            slot = i;
+        }
+    }
+    memset(&entry, 0, sizeof(entry));
+}
+
+void FaultRecorder::tick(const uint32_t now)
+{
+    if (!frozen)
+    {
+        if (now - sampleTime >= FAULT_SAMPLE_INTERVAL)
+        {
+            sampleTime = now;
+            sample();
+        }
+    }
+    else if (saved < sizeof(FaultEntry))
+    {
+        // Save the next chunk if there is room. The CRC is last, so an entry
+        // is only valid once it is completely written.
+        uint8_t length = min(sizeof(FaultEntry) - saved, FAULT_CHUNK_LENGTH);
+        if (writer.write(slotAddress(slot) + saved, (const uint8_t *)&entry + saved, length))
+        {
+            saved += length;
+        }
+    }
+    else if (!writer.busy())
+    {
+        // Finished. Start sampling again.
+        frozen = false;
+        ringIndex = 0;
+        used = 0;
+    }
+
+    // Print the next line of the log if the serial buffer has room, so
+    // printing never holds up the loop.
+    if (dumpOut && dumpOut->availableForWrite() >= SERIAL_DUMP_SPACE)
+    {
+        printNext();
+    }
+}
+
+void FaultRecorder::sample()
+{
+    entry.samples[ringIndex].pack(state);
+    ringIndex = ringIndex + 1 == FAULT_SAMPLES ? 0 : ringIndex + 1;
+    if (used < FAULT_SAMPLES)
+    {
+        used++;
+    }
+}
+
+void FaultRecorder::record(const EngineState fault)
+{
+    if (frozen)
+    {
+        // Still saving the last one.
+        return;
+    }
+
+    // Take a sample at the time of the fault, then put the ring in order.
+    sample();
+    for (uint8_t i = 0; i < ringIndex; i++)
+    {
+        // Rotate left by one, ringIndex times. Slow but rare and small.
+        FaultSample first = entry.samples[0];
+        memmove(&entry.samples[0], &entry.samples[1], sizeof(FaultSample) * (FAULT_SAMPLES - 1));
+        entry.samples[FAULT_SAMPLES - 1] = first;
+    }
+
+    sequence++;
+    slot = slot + 1 == FAULT_LOG_ENTRIES ? 0 : slot + 1;
+    entry.sequence = sequence;
+    entry.fault = fault;
+    entry.totalMinutes = state.totalMinutes;
+    entry.used = used;
+    entry.crc = crc(entry);
+    frozen = true;
+    saved = 0;
+}
+
+void FaultRecorder::flush()
+{
+    while (frozen)
+    {
+        tick(millis());
+    }
+}
+
+bool FaultRecorder::read(const uint8_t index, FaultEntry &out) const
+{
+    return readPart(index, 0, &out, sizeof(out));
+}
+
+bool FaultRecorder::read(const uint8_t index, FaultSummary &out) const
+{
+    return readPart(index, offsetof(FaultEntry, fault), &out.fault, sizeof(out.fault)) &&
+           readPart(index, offsetof(FaultEntry, totalMinutes), &out.totalMinutes, sizeof(out.totalMinutes)) &&
+           readPart(index, offsetof(FaultEntry, samples) + (FAULT_SAMPLES - 1) * sizeof(FaultSample), &out.last, sizeof(out.last));
+}
+
+void FaultRecorder::dump(Print &out)
+{
+    out.println(F("Fault log (newest first). Samples are oldest first, every " xstr(FAULT_SAMPLE_INTERVAL) "ms."));
+    dumpOut = &out;
+    dumpSequence = sequence;
+    dumpRow = 0;
+}
+
+void FaultRecorder::printNext()
+{
+    // Follow the entry by sequence in case a new fault is recorded part way.
+    Print &out = *dumpOut;
+    const uint16_t index = sequence - dumpSequence;
+    uint8_t count;
+    if (index >= FAULT_LOG_ENTRIES || !readPart(index, offsetof(FaultEntry, used), &count, sizeof(count)))
+    {
+        // Printed everything or the rest has been overwritten.
+        dumpOut = nullptr;
+        return;
+    }
+
+    if (dumpRow == 0)
+    {
+        FaultSummary summary;
+        read(index, summary);
+        out.print(F("Entry,"));
+        out.print(index);
+        out.write(',');
+        printFault(out, summary.fault);
+        out.print(F(",Minutes,"));
+        out.println(summary.totalMinutes);
+    }
+    else if (dumpRow == 1)
+    {
+        out.println(F("Temperature,Voltage,RPM,Oil,OilExpected,Running"));
+    }
+    else
+    {
+        FaultSample sample;
+        const uint8_t i = FAULT_SAMPLES - count + dumpRow - 2;
+        readPart(index, offsetof(FaultEntry, samples) + i * sizeof(FaultSample), &sample, sizeof(sample));
+        out.print(sample.temperature());
+        out.write(',');
+        out.print(sample.voltage() / 10);
+        out.write('.');
+        out.print(sample.voltage() % 10);
+        out.write(',');
+        out.print(sample.rpm());
+        out.write(',');
+        out.print(sample.oilPressure());
+        out.write(',');
+        out.print(sample.oilExpected());
+        out.write(',');
+        out.println(sample.running());
+    }
+
+    // Move on to the next row, or the next entry after the last sample.
+    dumpRow++;
+    if (dumpRow == count + 2)
+    {
+        dumpRow = 0;
+        dumpSequence--;
+    }
+}
+
+void FaultRecorder::printFault(Print &out, const uint8_t fault)
+{
+    switch (fault)
+    {
+    case OVER_TEMP:
+        out.print(F("Over temp"));
+        break;
+    case OVER_REV:
+        out.print(F("Over rev"));
+        break;
+    case OIL_PRESSURE:
+        out.print(F("Oil press"));
+        break;
+    case TEMP_PROBE:
+        out.print(F("Temp sens"));
+        break;
+    default:
+        out.print(F("State "));
+        out.print(fault);
+    }
+}
+
+uint16_t FaultRecorder::check(const uint8_t index) const
+{
+    if (index >= FAULT_LOG_ENTRIES)
+    {
+        return 0;
+    }
+
+    // Entries are written in slot order, so older ones are in the slots before.
+    uint16_t address = slotAddress((slot + FAULT_LOG_ENTRIES - index) % FAULT_LOG_ENTRIES);
+    uint16_t expected = 0xff00 | crcSeed;
+    for (uint8_t i = 0; i < offsetof(FaultEntry, crc); i++)
+    {
+        expected = _crc_ccitt_update(expected, EepromWriter::read(address + i));
+    }
+
+    uint16_t saved, savedSequence;
+    EepromWriter::get(address + offsetof(FaultEntry, crc), saved);
+    EepromWriter::get(address + offsetof(FaultEntry, sequence), savedSequence);
+    return saved == expected && savedSequence == (uint16_t)(sequence - index) ? address : 0;
+}
+
+bool FaultRecorder::readPart(const uint8_t index, const uint8_t offset, void *out, const uint8_t length) const
+{
+    if (frozen && index == 0)
+    {
+        // Still being saved, so EEPROM only has part of it.
+        memcpy(out, (const uint8_t *)&entry + offset, length);
+        return true;
+    }
+
+    uint16_t address = check(index);
+    if (address)
+    {
+        for (uint8_t i = 0; i < length; i++)
+        {
+            ((uint8_t *)out)[i] = EepromWriter::read(address + offset + i);
+        }
+    }
+    return address;
+}
+
+uint16_t FaultRecorder::crc(const FaultEntry &check) const
+{
+    uint16_t result = 0xff00 | crcSeed;
+    const uint8_t *bytes = (const uint8_t *)&check;
+    for (uint8_t i = 0; i < offsetof(FaultEntry, crc); i++)
+    {
+        result = _crc_ccitt_update(result, bytes[i]);
+    }
+    return result;
+}
@@ -0,0 +1,214 @@
+/**
+ * @file faults.h
+ * @brief Black box recorder that saves what led up to each shutdown.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-26
+ */
+#pragma once
+#include "defines.h"
+#include "state.h"
+#include "eepromwriter.h"
+
+/**
+ * @brief The state at one point in time, packed into 3 bytes.
+ *
+ * Byte 0 is the temperature (0 to 255C), byte 1 is the voltage (6.0V to
+ * 18.6V in 0.2V steps) in the low 6 bits, the oil pressure in bit 6 and
+ * whether oil pressure was expected in bit 7. Byte 2 is the rpm / 32 in the
+ * low 7 bits and whether the engine was running in bit 7.
+ *
+ */
+struct FaultSample
+{
+    uint8_t bytes[3];
+
+    /**
+     * @brief Packs the current state.
+     *
+     */
+    void pack(const State &state);
+
+    int16_t temperature() const { return bytes[0]; }
+    uint8_t voltage() const { return 60 + (bytes[1] & 0x3f) * 2; } // Tenths of a volt.
+    bool oilPressure() const { return bytes[1] & 0x40; }
+    bool oilExpected() const { return bytes[1] & 0x80; }
+    uint16_t rpm() const { return (bytes[2] & 0x7f) * 32; }
+    bool running() const { return bytes[2] & 0x80; }
+};
+
+/**
+ * @brief A saved fault, as stored in EEPROM.
+ *
+ */
+struct FaultEntry
+{
+    uint16_t sequence;
+    uint8_t fault; // EngineState
+    uint32_t totalMinutes; // Engine hours at the time.
+    uint8_t used; // Samples taken. Only the last used samples are valid if the fault was soon after startup.
+    FaultSample samples[FAULT_SAMPLES]; // Oldest first. The last is at the time of the fault.
+    uint16_t crc;
+} __attribute__((packed));
+
+/**
+ * @brief The parts of a saved fault shown on the LCD.
+ *
+ */
+struct FaultSummary
+{
+    uint8_t fault; // EngineState
+    uint32_t totalMinutes;
+    FaultSample last; // At the time of the fault.
+};
+
+/**
+ * @brief Keeps the last FAULT_SAMPLES samples of the state in RAM and saves
+ * them to a ring of FAULT_LOG_ENTRIES entries in EEPROM on each shutdown.
+ *
+ */
+class FaultRecorder
+{
+public:
+    /**
+     * @brief Construct a new Fault Recorder object.
+     *
+     * @param writer the writer to save entries with.
+     */
+    FaultRecorder(EepromWriter &writer) : writer(writer) {}
+
+    /**
+     * @brief Finds the newest entry in EEPROM.
+     *
+     * @param address the EEPROM address of the log.
+     * @param seed mixed into the CRC so entries from an old layout are invalid.
+     */
+    void begin(const uint16_t address, const uint8_t seed);
+
+    /**
+     * @brief Takes samples, saves any frozen entry a bit at a time and prints
+     * the next line of the log if dump() was called.
+     *
+     * @param now the current time in ms.
+     */
+    void tick(const uint32_t now);
+
+    /**
+     * @brief Freezes the samples and starts saving them. Ignored if the last
+     * fault is still being saved.
+     *
+     * @param fault the reason for the shutdown.
+     */
+    void record(const EngineState fault);
+
+    /**
+     * @brief Queues the rest of any entry being saved and waits for it to be
+     * written. Used when the power is failing.
+     *
+     */
+    void flush();
+
+    /**
+     * @brief Reads an entry. The newest comes from RAM while it is being
+     * saved.
+     *
+     * @param index 0 for the newest, increasing for older ones.
+     * @param entry where to put the entry.
+     * @return true if the entry exists.
+     * @return false if there is no valid entry.
+     */
+    bool read(const uint8_t index, FaultEntry &entry) const;
+
+    /**
+     * @brief Reads the summary of an entry without copying the whole entry.
+     *
+     * @param index 0 for the newest, increasing for older ones.
+     * @param summary where to put the summary.
+     * @return true if the entry exists.
+     * @return false if there is no valid entry.
+     */
+    bool read(const uint8_t index, FaultSummary &summary) const;
+
+    /**
+     * @brief Starts printing every saved entry as CSV. The title is printed
+     * now and each line after it is printed by a later tick().
+     *
+     * @param out where to print to.
+     */
+    void dump(Print &out);
+
+    /**
+     * @brief Prints the name of an error state. Names are at most 9
+     * characters so they fit on the LCD.
+     *
+     */
+    static void printFault(Print &out, const uint8_t fault);
+
+private:
+    /**
+     * @brief Adds the current state to the ring of samples.
+     *
+     */
+    void sample();
+
+    /**
+     * @brief Calculates the CRC of everything in an entry before the CRC.
+     *
+     */
+    uint16_t crc(const FaultEntry &entry) const;
+
+    /**
+     * @brief Checks that an entry in EEPROM is complete and is the expected
+     * one. The CRC is calculated directly from EEPROM.
+     *
+     * @param index 0 for the newest, increasing for older ones.
+     * @return uint16_t the address of the entry, or 0 if it isn't valid.
+     */
+    uint16_t check(const uint8_t index) const;
+
+    /**
+     * @brief Reads part of an entry, from RAM if it is still being saved or
+     * from EEPROM if it is valid.
+     *
+     * @param index 0 for the newest, increasing for older ones.
+     * @param offset of the part in FaultEntry.
+     * @param out where to put the part.
+     * @param length bytes in the part.
+     * @return true if the entry exists.
+     * @return false if there is no valid entry.
+     */
+    bool readPart(const uint8_t index, const uint8_t offset, void *out, const uint8_t length) const;
+
+    /**
+     * @brief Prints the next line of the log started by dump().
+     *
+     */
+    void printNext();
+
+    /**
+     * @brief Gets the EEPROM address of a slot.
+     *
+     */
+    uint16_t slotAddress(const uint8_t slot) const { return startAddress + slot * sizeof(FaultEntry); }
+
+    EepromWriter &writer;
+    uint16_t startAddress;
+    uint8_t crcSeed;
+    uint16_t sequence = 0; // Of the newest entry.
+    uint8_t slot = FAULT_LOG_ENTRIES - 1; // Of the newest entry.
+
+    // Samples are kept in the entry being built so they don't need copying.
+    // Until frozen, samples is a ring with the oldest at ringIndex.
+    FaultEntry entry;
+    uint8_t ringIndex = 0;
+    uint8_t used = 0;
+    uint32_t sampleTime = 0;
+    bool frozen = false;
+    uint8_t saved; // Bytes of the frozen entry that have been queued.
+
+    // Printing the log a line at a time.
+    Print *dumpOut = nullptr; // nullptr when not printing.
+    uint16_t dumpSequence; // Of the entry being printed.
+    uint8_t dumpRow; // 0 for the entry, 1 for the column names, then each sample.
+};
@@ -0,0 +1,638 @@
+/**
+ * @file graph.h
+ * @brief Graphs drawn using the LCD's custom characters.
+ *
+ * Everything here is templated on the sample type and sizes so that each graph
+ * gets statically allocated storage of the narrowest type that fits its data.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-22
+ */
+#pragma once
+#include "defines.h"
+#include "lcdbuffer.h"
+
+// Points from the level below in each point, for every level after the first.
+constexpr uint8_t GRAPH_LEVEL_FACTORS[] = GRAPH_ZOOM_FACTORS;
+static_assert(sizeof(GRAPH_LEVEL_FACTORS) == GRAPH_ZOOM_LEVELS - 1, "GRAPH_ZOOM_FACTORS needs a factor for each level after the first.");
+
+/**
+ * @brief Type to add up samples in. Byte samples only need 16 bits, as at
+ * most 255 are added together.
+ *
+ * @tparam T the sample type.
+ */
+template <typename T>
+struct GraphSum
+{
+    typedef int32_t Type;
+};
+
+template <>
+struct GraphSum<uint8_t>
+{
+    typedef uint16_t Type;
+};
+
+/**
+ * @brief Summary of the data that makes up a single point on a graph.
+ *
+ * @tparam T the sample type.
+ */
+template <typename T>
+struct GraphBucket
+{
+    T min;
+    T max;
+    T mean;
+};
+
+/**
+ * @brief Combines data into a bucket as it arrives.
+ *
+ * @tparam T the sample type.
+ */
+template <typename T>
+struct GraphAccumulator
+{
+    /**
+     * @brief Adds a sample or a finished bucket from a finer level.
+     *
+     * @param bucket the data to add.
+     */
+    void add(const GraphBucket<T> &bucket)
+    {
+        if (!count || bucket.min < min)
+        {
+            min = bucket.min;
+        }
+        if (!count || bucket.max > max)
+        {
+            max = bucket.max;
+        }
+        sum += bucket.mean;
+        count++;
+    }
+
+    /**
+     * @brief Returns the combined bucket and starts a new one.
+     *
+     * @tparam COUNT the number of points added. Being a template parameter
+     *               makes the divisor a compile time constant.
+     */
+    template <uint16_t COUNT>
+    GraphBucket<T> take()
+    {
+        GraphBucket<T> bucket;
+        bucket.min = min;
+        bucket.max = max;
+        bucket.mean = sum / COUNT;
+        sum = 0;
+        count = 0;
+        return bucket;
+    }
+
+    T min = 0;
+    T max = 0;
+    typename GraphSum<T>::Type sum = 0;
+    uint8_t count = 0;
+};
+
+/**
+ * @brief Ring buffer of the most recent buckets.
+ *
+ * @tparam T the sample type.
+ * @tparam LENGTH the number of buckets to keep.
+ */
+template <typename T, uint8_t LENGTH>
+class BucketRing
+{
+public:
+    /**
+     * @brief Adds a bucket, replacing the oldest one if full.
+     *
+     * @param bucket the bucket to add.
+     */
+    void add(const GraphBucket<T> &bucket)
+    {
+        if (used < LENGTH)
+        {
+            buckets[position(used)] = bucket;
+            used++;
+        }
+        else
+        {
+            // Full. Replace the oldest.
+            buckets[start] = bucket;
+            start = (start + 1) % LENGTH;
+        }
+    }
+
+    /**
+     * @brief Gets a bucket.
+     *
+     * @param index the index, with 0 being the oldest.
+     * @return const GraphBucket<T>& the bucket.
+     */
+    const GraphBucket<T> &operator[](uint8_t index) const { return buckets[position(index)]; }
+
+    /**
+     * @brief Gets a bucket by where it is stored in the ring.
+     *
+     * @param position the position from position().
+     * @return const GraphBucket<T>& the bucket.
+     */
+    const GraphBucket<T> &at(uint8_t position) const { return buckets[position]; }
+
+    /**
+     * @brief Converts an index (0 being the oldest) to where that bucket is
+     * stored.
+     *
+     */
+    uint8_t position(uint8_t index) const { return (start + index) % LENGTH; }
+
+    /**
+     * @brief Returns the number of buckets stored.
+     *
+     */
+    uint8_t count() const { return used; }
+
+    /**
+     * @brief Returns true if there are LENGTH buckets stored.
+     *
+     */
+    bool full() const { return used == LENGTH; }
+
+private:
+    GraphBucket<T> buckets[LENGTH];
+    uint8_t start = 0; // Position of the oldest bucket.
+    uint8_t used = 0;
+};
+
+/**
+ * @brief Keeps track of the minimum, maximum and mean of everything in a
+ * BucketRing.
+ *
+ * The minimum and maximum are found using monotonic queues of positions in the
+ * ring buffer, so adding a bucket and getting the statistics are both O(1)
+ * (amortised) without having to scan the whole buffer.
+ *
+ * @tparam T the sample type.
+ * @tparam LENGTH the length of the rings that will be tracked.
+ */
+template <typename T, uint8_t LENGTH>
+class WindowStats
+{
+public:
+    typedef BucketRing<T, LENGTH> Ring;
+
+    /**
+     * @brief Starts tracking a ring, adding everything already in it.
+     *
+     * @param ring the ring to track.
+     */
+    void reset(const Ring &ring)
+    {
+        sum = 0;
+        minHead = 0;
+        minCount = 0;
+        maxHead = 0;
+        maxCount = 0;
+        for (uint8_t i = 0; i < ring.count(); i++)
+        {
+            push(ring, ring.position(i));
+        }
+    }
+
+    /**
+     * @brief Removes the oldest bucket if it is about to be replaced. Call
+     * before adding to the ring.
+     *
+     * @param ring the ring being tracked.
+     */
+    void removeOldest(const Ring &ring)
+    {
+        if (!ring.full())
+        {
+            // Nothing will be replaced.
+            return;
+        }
+
+        // The oldest will be at the head of the queues if it is in them.
+        uint8_t position = ring.position(0);
+        sum -= ring.at(position).mean;
+        if (minCount && minQueue[minHead] == position)
+        {
+            minHead = (minHead + 1) % LENGTH;
+            minCount--;
+        }
+        if (maxCount && maxQueue[maxHead] == position)
+        {
+            maxHead = (maxHead + 1) % LENGTH;
+            maxCount--;
+        }
+    }
+
+    /**
+     * @brief Adds the newest bucket. Call after adding to the ring.
+     *
+     * @param ring the ring being tracked.
+     */
+    void addNewest(const Ring &ring)
+    {
+        push(ring, ring.position(ring.count() - 1));
+    }
+
+    /**
+     * @brief Returns the smallest minimum of all buckets. Only valid if not
+     * empty.
+     *
+     */
+    T lowest(const Ring &ring) const { return ring.at(minQueue[minHead]).min; }
+
+    /**
+     * @brief Returns the largest maximum of all buckets. Only valid if not
+     * empty.
+     *
+     */
+    T highest(const Ring &ring) const { return ring.at(maxQueue[maxHead]).max; }
+
+    /**
+     * @brief Returns the mean of the bucket means. Only valid if not empty.
+     *
+     */
+    T mean(const Ring &ring) const { return sum / ring.count(); }
+
+private:
+    /**
+     * @brief Adds a bucket to the end of the queues.
+     *
+     * @param ring the ring being tracked.
+     * @param position the position of the bucket in the ring.
+     */
+    void push(const Ring &ring, uint8_t position)
+    {
+        const GraphBucket<T> &bucket = ring.at(position);
+        sum += bucket.mean;
+
+        // Anything in the queues that isn't better than the new bucket will
+        // never be the min / max again while the new bucket is in the window.
+        while (minCount && ring.at(minQueue[(minHead + minCount - 1) % LENGTH]).min >= bucket.min)
+        {
+            minCount--;
+        }
+        minQueue[(minHead + minCount) % LENGTH] = position;
+        minCount++;
+
+        while (maxCount && ring.at(maxQueue[(maxHead + maxCount - 1) % LENGTH]).max <= bucket.max)
+        {
+            maxCount--;
+        }
+        maxQueue[(maxHead + maxCount) % LENGTH] = position;
+        maxCount++;
+    }
+
+    typename GraphSum<T>::Type sum = 0; // Sum of the bucket means.
+
+    // Monotonic queues of positions in the ring. The head is the position of
+    // the current min / max. Later positions are candidates for when the
+    // head is removed.
+    uint8_t minQueue[LENGTH];
+    uint8_t maxQueue[LENGTH];
+    uint8_t minHead = 0, minCount = 0;
+    uint8_t maxHead = 0, maxCount = 0;
+};
+
+/**
+ * @brief Tag type used to pick the addBucket() and combine() overloads for a
+ * level at compile time.
+ *
+ * @tparam LEVEL the zoom level.
+ */
+template <uint8_t LEVEL>
+struct GraphLevel
+{
+};
+
+/**
+ * @brief A graph drawn on the bottom left of the screen using the custom
+ * characters.
+ *
+ * Each point is either drawn as a bar covering the min to max of the data that
+ * went into it (so short spikes aren't averaged away), or as a single dot at
+ * the mean.
+ *
+ * Each character is 5 points wide and uses the custom character slot with the
+ * same index as its position. Only slots affected by new data or the scale
+ * changing are regenerated.
+ *
+ * History is kept at GRAPH_ZOOM_LEVELS resolutions. Each level's buckets are
+ * made by combining GRAPH_ZOOM_FACTORS buckets from the level below as they
+ * are finished, so any level can be shown straight away.
+ *
+ * @tparam T the sample type. Use the narrowest type that fits the data.
+ * @tparam WIDTH the width in characters (up to 8).
+ * @tparam PLOT_EVERY how many samples to combine into each point at the most
+ *                    zoomed in level.
+ */
+template <typename T, uint8_t WIDTH, uint8_t PLOT_EVERY>
+class Graph
+{
+public:
+    /**
+     * @brief Construct a new Graph object.
+     *
+     * @param lcd the lcd to draw on.
+     */
+    Graph(LCDBuffer &lcd) : lcd(lcd) {}
+
+    /**
+     * @brief Adds a datapoint to be averaged. The max and min of the points
+     * since the last average are also recorded.
+     *
+     * If there are more than PLOT_EVERY points, then add to the graph.
+     *
+     * @param data the point to add.
+     */
+    void addData(T data)
+    {
+        GraphBucket<T> sample;
+        sample.min = data;
+        sample.max = data;
+        sample.mean = data;
+        combine(GraphLevel<0>(), sample);
+        updateScale();
+    }
+
+    /**
+     * @brief Regenerates custom characters that have changed and queues them
+     * to be sent to the LCD. Does nothing if there haven't been any changes.
+     *
+     * @param all if true, regenerates every character (for when another graph
+     *            may have been using the custom characters).
+     */
+    void setRegisters(bool all = false)
+    {
+        if (all)
+        {
+            setAllDirty();
+        }
+
+        for (uint8_t slot = 0; dirtySlots; slot++)
+        {
+            if (dirtySlots & (1 << slot))
+            {
+                drawChar(slot);
+                dirtySlots &= ~(1 << slot);
+            }
+        }
+    }
+
+    /**
+     * @brief Draws the graph in the bottom left corner.
+     *
+     * @code setRegisters() @endcode needs to be called separetely.
+     *
+     */
+    void display()
+    {
+        lcd.setCursor(0, 1);
+        for (uint8_t i = 0; i < WIDTH; i++)
+        {
+            lcd.write(i);
+        }
+    }
+
+    /**
+     * @brief Shows the next zoom level, going back to the most zoomed in after
+     * the most zoomed out.
+     *
+     */
+    void zoom()
+    {
+        zoomLevel++;
+        if (zoomLevel >= GRAPH_ZOOM_LEVELS)
+        {
+            zoomLevel = 0;
+        }
+        stats.reset(levels[zoomLevel]);
+        updateScale();
+        setAllDirty();
+    }
+
+    /**
+     * @brief Returns how many minutes the width of the graph covers at the
+     * current zoom level.
+     *
+     */
+    uint16_t spanMinutes() const
+    {
+        uint32_t samples = LENGTH;
+        for (uint8_t level = 0; level <= zoomLevel; level++)
+        {
+            samples *= factor(level);
+        }
+        return samples * DISPLAY_UPDATE_INTERVAL / 60000;
+    }
+
+    /**
+     * @brief Returns the mean of the points currently on the graph. Only valid
+     * if there are points on the graph.
+     *
+     */
+    T mean() const { return stats.mean(levels[zoomLevel]); }
+
+    // Smallest and largest data over the width of the graph and any data that
+    // hasn't been plotted yet. The graph is scaled to fit these.
+    T yMin = 0;
+    T yMax = 0;
+
+    // If true, draws the min to max of each point. Otherwise only draws the
+    // mean.
+    bool envelope = true;
+
+protected:
+    static const uint8_t CHAR_WIDTH = 5;
+    static const uint8_t CHAR_HEIGHT = 8;
+    static const uint8_t LENGTH = WIDTH * CHAR_WIDTH; // Width in points.
+    typedef BucketRing<T, LENGTH> Ring;
+
+    /**
+     * @brief Returns how many points from the level below make up a point.
+     *
+     * @param level the level.
+     */
+    static constexpr uint8_t factor(uint8_t level)
+    {
+        return level ? GRAPH_LEVEL_FACTORS[level - 1] : PLOT_EVERY;
+    }
+
+    /**
+     * @brief Adds data to the bucket being filled on a level, adding it to the
+     * graph if full.
+     *
+     * @tparam LEVEL the level to add to.
+     * @param bucket a sample or finished bucket from the level below.
+     */
+    template <uint8_t LEVEL>
+    void combine(GraphLevel<LEVEL>, const GraphBucket<T> &bucket)
+    {
+        GraphAccumulator<T> &accumulator = pending[LEVEL];
+        accumulator.add(bucket);
+        if (accumulator.count >= factor(LEVEL))
+        {
+            addBucket(GraphLevel<LEVEL>(), accumulator.template take<factor(LEVEL)>());
+        }
+    }
+
+    /**
+     * @brief Called when there are no more levels to combine into.
+     *
+     */
+    void combine(GraphLevel<GRAPH_ZOOM_LEVELS>, const GraphBucket<T> &) {}
+
+    /**
+     * @brief Adds a finished bucket to a level and passes it up to the next
+     * level.
+     *
+     * @tparam LEVEL the level to add to.
+     * @param bucket the bucket.
+     */
+    template <uint8_t LEVEL>
+    void addBucket(GraphLevel<LEVEL>, const GraphBucket<T> &bucket)
+    {
+        Ring &ring = levels[LEVEL];
+        if (LEVEL == zoomLevel)
+        {
+            // Shown on the screen.
+            if (!ring.full())
+            {
+                // Still filling up. Only the character the point is in changes.
+                dirtySlots |= 1 << (ring.count() / CHAR_WIDTH);
+            }
+            else
+            {
+                // Full. Replacing the oldest point scrolls everything left.
+                setAllDirty();
+            }
+            stats.removeOldest(ring);
+            ring.add(bucket);
+            stats.addNewest(ring);
+        }
+        else
+        {
+            ring.add(bucket);
+        }
+
+        combine(GraphLevel<LEVEL + 1>(), bucket);
+    }
+
+    /**
+     * @brief Updates yMin and yMax, redrawing everything if they changed.
+     *
+     */
+    void updateScale()
+    {
+        // Combine the points on the graph with those waiting to be added to it.
+        GraphAccumulator<T> combined;
+        const Ring &ring = levels[zoomLevel];
+        if (ring.count())
+        {
+            GraphBucket<T> shown;
+            shown.min = stats.lowest(ring);
+            shown.max = stats.highest(ring);
+            combined.add(shown);
+        }
+        for (uint8_t level = 0; level <= zoomLevel; level++)
+        {
+            if (pending[level].count)
+            {
+                GraphBucket<T> waiting;
+                waiting.min = pending[level].min;
+                waiting.max = pending[level].max;
+                combined.add(waiting);
+            }
+        }
+
+        if (combined.count && (combined.min != yMin || combined.max != yMax))
+        {
+            yMin = combined.min;
+            yMax = combined.max;
+            setAllDirty();
+        }
+    }
+
+    /**
+     * @brief Generates the bitmap of a custom character and queues it to be
+     * uploaded.
+     *
+     * @param slot the character to generate.
+     */
+    void drawChar(uint8_t slot)
+    {
+        const Ring &ring = levels[zoomLevel];
+        uint8_t bitmap[CHAR_HEIGHT] = {0};
+        for (uint8_t col = 0; col < CHAR_WIDTH; col++)
+        {
+            uint8_t index = slot * CHAR_WIDTH + col;
+            if (index >= ring.count())
+            {
+                // No data this far across yet.
+                break;
+            }
+
+            const GraphBucket<T> &point = ring[index];
+            uint8_t bit = 0x10 >> col;
+            if (envelope)
+            {
+                // Fill from the max down to the min.
+                uint8_t bottom = toRow(point.min);
+                for (uint8_t row = toRow(point.max); row <= bottom; row++)
+                {
+                    bitmap[row] |= bit;
+                }
+            }
+            else
+            {
+                bitmap[toRow(point.mean)] |= bit;
+            }
+        }
+
+        // The buffer won't resend the character if it is unchanged.
+        lcd.createChar(slot, bitmap);
+    }
+
+    /**
+     * @brief Works out which row of a custom character a value is drawn on.
+     *
+     * @param value the value.
+     * @return uint8_t the row, with 0 being the top.
+     */
+    uint8_t toRow(T value)
+    {
+        // Scale so that yMin is on the bottom row and yMax on the top.
+        int16_t range = yMax - yMin;
+        if (!range)
+        {
+            return CHAR_HEIGHT / 2;
+        }
+        return (CHAR_HEIGHT - 1) - (int32_t)(value - yMin) * (CHAR_HEIGHT - 1) / range;
+    }
+
+    /**
+     * @brief Marks every character as needing to be regenerated.
+     *
+     */
+    void setAllDirty()
+    {
+        dirtySlots = (1 << WIDTH) - 1;
+    }
+
+    LCDBuffer &lcd;
+    Ring levels[GRAPH_ZOOM_LEVELS];
+    GraphAccumulator<T> pending[GRAPH_ZOOM_LEVELS]; // Buckets being filled.
+    WindowStats<T, LENGTH> stats;                   // For the level shown.
+    uint8_t zoomLevel = 0;
+    uint8_t dirtySlots = 0; // Bitmask of characters that need regenerating.
+};
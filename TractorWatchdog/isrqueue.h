@@ -0,0 +1,101 @@
+/**
+ * @file isrqueue.h
+ * @brief Queue for passing values from an interrupt to the main loop.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-21
+ */
+#pragma once
+#include "defines.h"
+
+/**
+ * @brief Single producer, single consumer ring buffer.
+ *
+ * One side (normally an ISR) only calls push() and the other (normally the
+ * main loop) only calls pop(). Each index is only written by one side and is a
+ * single byte, so neither side needs to disable interrupts.
+ *
+ * One slot is always left empty to tell a full queue from an empty one.
+ *
+ * @tparam T the type of value to store.
+ * @tparam LENGTH the number of slots (holds up to LENGTH - 1 values).
+ */
+template <typename T, uint8_t LENGTH>
+class IsrQueue
+{
+public:
+    /**
+     * @brief Adds a value to the queue. Only call from the producer.
+     *
+     * @param value the value to add.
+     * @return true if the value was added.
+     * @return false if the queue was full and the value was dropped.
+     */
+    bool push(const T value)
+    {
+        uint8_t next = advance(head);
+        if (next == tail)
+        {
+            return false;
+        }
+        items[head] = value;
+        barrier(); // Make sure the value is written before it is published.
+        head = next;
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest value from the queue. Only call from the
+     * consumer.
+     *
+     * @param value where to put the value.
+     * @return true if a value was removed.
+     * @return false if the queue was empty.
+     */
+    bool pop(T &value)
+    {
+        uint8_t current = tail;
+        if (current == head)
+        {
+            return false;
+        }
+        barrier(); // Don't read the value before checking it was published.
+        value = items[current];
+        barrier(); // Read the value before giving the slot back.
+        tail = advance(current);
+        return true;
+    }
+
+    /**
+     * @brief Removes everything from the queue. Only call from the consumer.
+     *
+     */
+    void clear()
+    {
+        tail = head;
+    }
+
+private:
+    /**
+     * @brief Returns the index after the given one.
+     *
+     */
+    static uint8_t advance(const uint8_t index)
+    {
+        return index + 1 == LENGTH ? 0 : index + 1;
+    }
+
+    /**
+     * @brief Stops the compiler moving memory accesses across this point.
+     *
+     */
+    static inline void barrier()
+    {
+        asm volatile("" ::: "memory");
+    }
+
+    T items[LENGTH];
+    volatile uint8_t head = 0; // Next slot to write. Only changed by push().
+    volatile uint8_t tail = 0; // Next slot to read. Only changed by pop().
+};
@@ -0,0 +1,73 @@
+/**
+ * @file journal.cpp
+ * @brief Wear levelled journal of the engine hour counters in EEPROM.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-24
+ */
+#include "journal.h"
+#include <util/crc16.h>
+
+bool HoursJournal::restore(uint32_t &totalSeconds, uint32_t &tripSeconds)
+{
+    bool found = false;
+    for (uint8_t i = 0; i < HOURS_JOURNAL_SLOTS; i++)
+    {
+        HoursRecord record;
+        EepromWriter::get(slotAddress(i), record);
+        if (record.crc == crc(record) && (!found || (int16_t)(record.sequence - sequence) > 0))
+        {
+            found = true;
+            sequence = record.sequence;
+            slot = i;
+            totalSeconds = record.totalSeconds;
+            tripSeconds = record.tripSeconds;
+        }
+    }
+    return found;
+}
+
+bool HoursJournal::save(const uint32_t totalSeconds, const uint32_t tripSeconds)
+{
+    prepare(totalSeconds, tripSeconds);
+    return commit();
+}
+
+void HoursJournal::prepare(const uint32_t totalSeconds, const uint32_t tripSeconds)
+{
+    prepared.sequence = sequence + 1;
+    prepared.totalSeconds = totalSeconds;
+    prepared.tripSeconds = tripSeconds;
+    prepared.crc = crc(prepared);
+    uncommitted = true;
+}
+
+bool HoursJournal::commit()
+{
+    if (!uncommitted)
+    {
+        return true;
+    }
+
+    uint8_t next = slot + 1 == HOURS_JOURNAL_SLOTS ? 0 : slot + 1;
+    if (!writer.write(slotAddress(next), &prepared, sizeof(prepared)))
+    {
+        return false;
+    }
+    sequence = prepared.sequence;
+    slot = next;
+    uncommitted = false;
+    return true;
+}
+
+uint16_t HoursJournal::crc(const HoursRecord &record) const
+{
+    uint16_t result = 0xff00 | crcSeed;
+    const uint8_t *bytes = (const uint8_t *)&record;
+    for (uint8_t i = 0; i < offsetof(HoursRecord, crc); i++)
+    {
+        result = _crc_ccitt_update(result, bytes[i]);
+    }
+    return result;
+}
@@ -0,0 +1,113 @@
+/**
+ * @file journal.h
+ * @brief Wear levelled journal of the engine hour counters in EEPROM.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-24
+ */
+#pragma once
+#include "defines.h"
+#include "eepromwriter.h"
+
+/**
+ * @brief One saved copy of the hour counters.
+ *
+ */
+struct HoursRecord
+{
+    uint16_t sequence; // Increases by one each save, so the newest record can be found.
+    uint32_t totalSeconds;
+    uint32_t tripSeconds;
+    uint16_t crc;
+} __attribute__((packed));
+
+/**
+ * @brief Saves the hour counters to a ring of records in EEPROM.
+ *
+ * Each save goes to the next slot, spreading the wear over HOURS_JOURNAL_SLOTS
+ * slots. On startup the valid record with the newest sequence number is used,
+ * so a save that was cut off by losing power just falls back to the previous
+ * one.
+ *
+ */
+class HoursJournal
+{
+public:
+    /**
+     * @brief Construct a new Hours Journal object.
+     *
+     * @param writer the writer to queue saves with.
+     */
+    HoursJournal(EepromWriter &writer) : writer(writer) {}
+
+    /**
+     * @brief Sets where the journal is. Call before anything else.
+     *
+     * @param address the EEPROM address of the first slot.
+     * @param seed mixed into the CRC so records from an old layout are invalid.
+     */
+    void begin(const uint16_t address, const uint8_t seed)
+    {
+        startAddress = address;
+        crcSeed = seed;
+    }
+
+    /**
+     * @brief Finds the newest valid record.
+     *
+     * @param totalSeconds set to the total time if found.
+     * @param tripSeconds set to the trip time if found.
+     * @return true if a valid record was found.
+     * @return false if there are no valid records (the values are unchanged).
+     */
+    bool restore(uint32_t &totalSeconds, uint32_t &tripSeconds);
+
+    /**
+     * @brief Queues a record to be saved in the background.
+     *
+     * @param totalSeconds the total time.
+     * @param tripSeconds the trip time.
+     * @return true if queued.
+     * @return false if the writer is full.
+     */
+    bool save(const uint32_t totalSeconds, const uint32_t tripSeconds);
+
+    /**
+     * @brief Encodes the next record ahead of time so that commit() only needs
+     * to queue the bytes.
+     *
+     * @param totalSeconds the total time.
+     * @param tripSeconds the trip time.
+     */
+    void prepare(const uint32_t totalSeconds, const uint32_t tripSeconds);
+
+    /**
+     * @brief Queues the prepared record if it hasn't been already.
+     *
+     * @return true if queued or nothing needed saving.
+     * @return false if the writer is full.
+     */
+    bool commit();
+
+private:
+    /**
+     * @brief Calculates the CRC of everything in a record before the CRC.
+     *
+     */
+    uint16_t crc(const HoursRecord &record) const;
+
+    /**
+     * @brief Gets the EEPROM address of a slot.
+     *
+     */
+    uint16_t slotAddress(const uint8_t slot) const { return startAddress + slot * sizeof(HoursRecord); }
+
+    EepromWriter &writer;
+    uint16_t startAddress;
+    uint8_t crcSeed;
+    HoursRecord prepared;
+    bool uncommitted = false; // True if prepared hasn't been queued.
+    uint16_t sequence = 0; // Of the newest record.
+    uint8_t slot = HOURS_JOURNAL_SLOTS - 1; // Of the newest record.
+};
@@ -0,0 +1,156 @@
+/**
+ * @file lcdbuffer.cpp
+ * @brief Shadow framebuffer that sits between the displays and the LCD.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-20
+ */
+#include "lcdbuffer.h"
+
+void LCDBuffer::begin()
+{
+    lcd.begin();
+    lcdCursor = CURSOR_UNKNOWN;
+
+    // The LCD is blank after initialising. The custom characters are
+    // unknown, so make sure they will be sent the first time they are set.
+    memset(shown, ' ', sizeof(shown));
+    memset(customChars, 0xff, sizeof(customChars));
+    clear();
+}
+
+void LCDBuffer::clear()
+{
+    memset(buffer, ' ', sizeof(buffer));
+    cursorCol = 0;
+    cursorRow = 0;
+}
+
+void LCDBuffer::setCursor(uint8_t col, uint8_t row)
+{
+    cursorCol = col;
+    cursorRow = row;
+}
+
+size_t LCDBuffer::write(uint8_t character)
+{
+    if (cursorRow < LCD_ROWS && cursorCol < LCD_COLS)
+    {
+        buffer[cursorRow * LCD_COLS + cursorCol] = character;
+    }
+    cursorCol++;
+    return 1;
+}
+
+void LCDBuffer::createChar(uint8_t location, uint8_t charmap[])
+{
+    location &= 0x7;
+    if (memcmp(customChars[location], charmap, CHAR_ROWS))
+    {
+        // Different to what the LCD has or will have.
+        memcpy(customChars[location], charmap, CHAR_ROWS);
+        customDirty |= 1 << location;
+    }
+}
+
+void LCDBuffer::backlight()
+{
+    lcd.backlight();
+}
+
+void LCDBuffer::noBacklight()
+{
+    lcd.noBacklight();
+}
+
+void LCDBuffer::flush()
+{
+    uint8_t budget = LCD_FLUSH_BUDGET;
+    while (budget)
+    {
+        // Custom characters go first so that they are correct once shown.
+        if (flushCustomChar())
+        {
+            budget--;
+        }
+        else if (!flushCell(budget))
+        {
+            // Nothing left to do.
+            break;
+        }
+    }
+    lcd.send();
+}
+
+bool LCDBuffer::flushCustomChar()
+{
+    if (customRow < CHAR_ROWS)
+    {
+        // Part way through uploading a character. The LCD's address counter
+        // is still in CGRAM, so carry on from where we left off.
+        lcd.write(customChars[customSlot][customRow]);
+        customRow++;
+        return true;
+    }
+    else if (customDirty)
+    {
+        // Start uploading the next waiting character.
+        customSlot = 0;
+        while (!(customDirty & (1 << customSlot)))
+        {
+            customSlot++;
+        }
+        customDirty &= ~(1 << customSlot);
+        customRow = 0;
+        lcd.command(0x40 | (customSlot << 3)); // Set CGRAM address.
+
+        // The LCD will need to be told where to write characters afterwards.
+        lcdCursor = CURSOR_UNKNOWN;
+        return true;
+    }
+    return false;
+}
+
+bool LCDBuffer::flushCell(uint8_t &budget)
+{
+    // Look for the next changed cell, wrapping around from where the last
+    // flush stopped.
+    for (uint8_t checked = 0; checked < CELLS; checked++)
+    {
+        uint8_t index = flushIndex;
+        flushIndex++;
+        if (flushIndex >= CELLS)
+        {
+            flushIndex = 0;
+        }
+
+        if (buffer[index] != shown[index])
+        {
+            // Changed. Only move the cursor if the last character written
+            // wasn't immediately to the left.
+            if (lcdCursor != index)
+            {
+                lcd.setCursor(index % LCD_COLS, index / LCD_COLS);
+                lcdCursor = index;
+                budget--;
+                if (!budget)
+                {
+                    // Out of time. Come back to this cell next time.
+                    flushIndex = index;
+                    return true;
+                }
+            }
+
+            lcd.write(buffer[index]);
+            shown[index] = buffer[index];
+            budget--;
+
+            // The next row isn't straight after this one in the LCD's memory.
+            lcdCursor = (flushIndex % LCD_COLS) ? flushIndex : CURSOR_UNKNOWN;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file lcdbuffer.h
+ * @brief Shadow framebuffer that sits between the displays and the LCD.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-20
+ */
+#pragma once
+#include "defines.h"
+#include "lcddriver.h"
+
+/**
+ * @brief Records what should be on the screen and only sends the characters
+ * that have changed to the LCD.
+ *
+ * Writing to the LCD over I2C is slow, so displays draw into this buffer as if
+ * it were the LCD and flush() is called once per loop to send a limited number
+ * of the differences. This puts an upper bound on how long each loop can be
+ * held up by the LCD.
+ *
+ */
+class LCDBuffer : public Print
+{
+public:
+    /**
+     * @brief Construct a new LCDBuffer object.
+     *
+     * @param lcd the physical LCD to draw to.
+     */
+    LCDBuffer(LCDDriver &lcd) : lcd(lcd) {}
+
+    /**
+     * @brief Initialises the LCD, turns on the backlight and clears the
+     * buffer.
+     *
+     */
+    void begin();
+
+    /**
+     * @brief Fills the buffer with spaces and moves the cursor to the top
+     * left. Nothing is sent to the LCD until flush() is called.
+     *
+     */
+    void clear();
+
+    /**
+     * @brief Sets where the next character written will be placed.
+     *
+     * @param col the column (0 is the left).
+     * @param row the row (0 is the top).
+     */
+    void setCursor(uint8_t col, uint8_t row);
+
+    /**
+     * @brief Writes a character to the buffer at the cursor and advances the
+     * cursor. Characters that fall off the right of the screen are dropped.
+     *
+     * @param character the character to write.
+     * @return size_t the number of characters written (always 1).
+     */
+    virtual size_t write(uint8_t character);
+    using Print::write;
+
+    /**
+     * @brief Queues a custom character to be uploaded to the LCD if it is
+     * different to the one already in that slot.
+     *
+     * Custom characters are uploaded before any changed cells are drawn.
+     *
+     * @param location the CGRAM slot (0 to 7).
+     * @param charmap the 8 rows of the character.
+     */
+    void createChar(uint8_t location, uint8_t charmap[]);
+
+    /**
+     * @brief Turns on the backlight.
+     *
+     */
+    void backlight();
+
+    /**
+     * @brief Turns off the backlight.
+     *
+     */
+    void noBacklight();
+
+    /**
+     * @brief Sends up to LCD_FLUSH_BUDGET bytes of changes to the LCD in as
+     * few I2C transactions as possible.
+     *
+     * Carries on from where the last call stopped. The LCD's cursor
+     * automatically advances after each write, so it is only moved when
+     * skipping over characters that haven't changed.
+     *
+     */
+    virtual void flush();
+
+private:
+    /**
+     * @brief Sends the next part of a custom character upload if there is one.
+     *
+     * @return true if a byte was sent.
+     * @return false if there are no custom characters waiting.
+     */
+    bool flushCustomChar();
+
+    /**
+     * @brief Sends the next changed cell (and the cursor move if needed).
+     *
+     * @param budget the number of bytes that can be sent. This is decreased
+     *               by the number sent.
+     * @return true if there might be more changed cells.
+     * @return false if the screen is up to date.
+     */
+    bool flushCell(uint8_t &budget);
+
+    static const uint8_t CELLS = LCD_ROWS * LCD_COLS;
+    static const uint8_t CHAR_ROWS = 8;
+    static const uint8_t CURSOR_UNKNOWN = 255;
+
+    LCDDriver &lcd;
+    uint8_t buffer[CELLS]; // What should be on the screen.
+    uint8_t shown[CELLS];  // What is currently on the screen.
+    uint8_t cursorCol = 0;
+    uint8_t cursorRow = 0;
+
+    uint8_t lcdCursor = CURSOR_UNKNOWN; // Cell the LCD will write to next.
+    uint8_t flushIndex = 0;             // Cell to resume checking from.
+
+    uint8_t customChars[8][CHAR_ROWS];
+    uint8_t customDirty = 0;         // Bitmask of slots waiting to upload.
+    uint8_t customSlot = 0;          // Slot being uploaded.
+    uint8_t customRow = CHAR_ROWS;   // Next row to upload, CHAR_ROWS if done.
+};
@@ -0,0 +1,124 @@
+/**
+ * @file lcddriver.cpp
+ * @brief Driver for HD44780 LCDs on a PCF8574 I2C backpack that batches
+ * writes into as few I2C transactions as possible.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-21
+ */
+#include "lcddriver.h"
+
+void LCDDriver::begin()
+{
+    Wire.begin();
+
+    // Wait for the LCD to power up, then follow the initialisation by
+    // instruction procedure in the HD44780 datasheet to get into 4 bit mode.
+    delay(50);
+    queue(backlightPin);
+    lastMode = backlightPin;
+    send();
+    writeNibbleNow(0x30);
+    delayMicroseconds(4500);
+    writeNibbleNow(0x30);
+    delayMicroseconds(4500);
+    writeNibbleNow(0x30);
+    delayMicroseconds(150);
+    writeNibbleNow(0x20);
+
+    command(0x28); // 4 bit, 2 lines, 5x8 font.
+    command(0x0c); // Display on, cursor off, blink off.
+    command(0x06); // Increment the address after each write, no shifting.
+    command(0x01); // Clear.
+    send();
+    delay(2); // Clearing is slow.
+}
+
+void LCDDriver::backlight()
+{
+    backlightPin = PIN_BACKLIGHT;
+    queue(backlightPin);
+    lastMode = backlightPin;
+    send();
+}
+
+void LCDDriver::noBacklight()
+{
+    backlightPin = 0;
+    queue(backlightPin);
+    lastMode = backlightPin;
+    send();
+}
+
+void LCDDriver::setCursor(uint8_t col, uint8_t row)
+{
+    const uint8_t ROW_OFFSETS[] = {0x00, 0x40, 0x14, 0x54};
+    command(0x80 | (col + ROW_OFFSETS[row & 0x3]));
+}
+
+void LCDDriver::command(uint8_t value)
+{
+    queueByte(value, 0);
+}
+
+void LCDDriver::write(uint8_t value)
+{
+    queueByte(value, PIN_RS);
+}
+
+void LCDDriver::send()
+{
+    if (queued)
+    {
+        Wire.endTransmission();
+        transactions++;
+        queued = 0;
+    }
+}
+
+void LCDDriver::queueByte(uint8_t value, uint8_t mode)
+{
+    // Keep each LCD byte within a single transaction.
+    if (queued + MAX_BYTE_LENGTH > BUFFER_LENGTH)
+    {
+        send();
+    }
+
+    // RS needs to settle before EN goes high, so set it by itself if changing.
+    // Otherwise the data and EN can change together as the LCD only latches
+    // the data when EN falls.
+    mode |= backlightPin;
+    if (mode != lastMode)
+    {
+        queue(mode);
+        lastMode = mode;
+    }
+
+    uint8_t high = (value & 0xf0) | mode;
+    uint8_t low = (value << 4) | mode;
+    queue(high | PIN_EN);
+    queue(high);
+    queue(low | PIN_EN);
+    queue(low);
+}
+
+void LCDDriver::queue(uint8_t value)
+{
+    if (!queued)
+    {
+        Wire.beginTransmission(address);
+    }
+    Wire.write(value);
+    queued++;
+    bytesSent++;
+}
+
+void LCDDriver::writeNibbleNow(uint8_t nibble)
+{
+    nibble |= backlightPin;
+    queue(nibble | PIN_EN);
+    queue(nibble);
+    send();
+    lastMode = backlightPin;
+}
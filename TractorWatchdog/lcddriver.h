@@ -0,0 +1,121 @@
+/**
+ * @file lcddriver.h
+ * @brief Driver for HD44780 LCDs on a PCF8574 I2C backpack that batches
+ * writes into as few I2C transactions as possible.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-21
+ */
+#pragma once
+#include "defines.h"
+
+#ifndef BUFFER_LENGTH
+#define BUFFER_LENGTH 32 // Size of the Wire library's transmit buffer.
+#endif
+
+/**
+ * @brief Sends commands and characters to the LCD.
+ *
+ * Bytes are queued up in the Wire library's buffer and sent together when it
+ * fills up or send() is called, instead of one transaction per nibble.
+ *
+ */
+class LCDDriver
+{
+public:
+    /**
+     * @brief Construct a new LCDDriver object.
+     *
+     * @param address the I2C address of the backpack.
+     */
+    LCDDriver(const uint8_t address) : address(address) {}
+
+    /**
+     * @brief Initialises the LCD in 4 bit mode and clears it.
+     *
+     * This blocks for a while and should only be called in setup.
+     *
+     */
+    void begin();
+
+    /**
+     * @brief Turns on the backlight.
+     *
+     */
+    void backlight();
+
+    /**
+     * @brief Turns off the backlight.
+     *
+     */
+    void noBacklight();
+
+    /**
+     * @brief Queues moving the LCD's cursor.
+     *
+     * @param col the column (0 is the left).
+     * @param row the row (0 is the top).
+     */
+    void setCursor(uint8_t col, uint8_t row);
+
+    /**
+     * @brief Queues a command for the LCD.
+     *
+     * @param value the command.
+     */
+    void command(uint8_t value);
+
+    /**
+     * @brief Queues a character (or CGRAM row) to be written to the LCD.
+     *
+     * @param value the character.
+     */
+    void write(uint8_t value);
+
+    /**
+     * @brief Sends anything queued to the LCD.
+     *
+     */
+    void send();
+
+    uint32_t bytesSent = 0;    // I2C bytes sent, for measuring efficiency.
+    uint32_t transactions = 0; // I2C transactions sent.
+
+private:
+    /**
+     * @brief Queues a whole byte as two nibbles.
+     *
+     * @param value the byte.
+     * @param mode PIN_RS for data, 0 for commands.
+     */
+    void queueByte(uint8_t value, uint8_t mode);
+
+    /**
+     * @brief Adds a byte to the current transaction, starting a new one if
+     * needed.
+     *
+     * @param value the state to set the PCF8574's pins to.
+     */
+    void queue(uint8_t value);
+
+    /**
+     * @brief Writes a single nibble straight away. Only used during begin().
+     *
+     * @param nibble the nibble in the upper 4 bits.
+     */
+    void writeNibbleNow(uint8_t nibble);
+
+    // PCF8574 to LCD connections.
+    static const uint8_t PIN_RS = 0x01;
+    static const uint8_t PIN_EN = 0x04;
+    static const uint8_t PIN_BACKLIGHT = 0x08;
+
+    // Largest number of I2C bytes needed for one LCD byte.
+    static const uint8_t MAX_BYTE_LENGTH = 5;
+
+    const uint8_t address;
+    uint8_t backlightPin = PIN_BACKLIGHT;
+    uint8_t lastMode = 0xff; // Mode of the last byte. Unknown to start with.
+    uint8_t queued = 0;      // Bytes in the current transaction.
+};
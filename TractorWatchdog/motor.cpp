@@ -23,9 +23,14 @@ void Motor::run()
 }
 
 void Motor::shutdown()
+{
+    stop();
+    Serial.println(F("Moving to stop position."));
+}
+
+void Motor::stop()
 {
     begin(); // Be safe as we don't want this to fail.
     digitalWrite(PIN_MOTOR_A, LOW);
     digitalWrite(PIN_MOTOR_B, HIGH);
-    Serial.println(F("Moving to stop position."));
 }
\ No newline at end of file
@@ -29,4 +29,11 @@ public:
      *
      */
     void shutdown();
+
+    /**
+     * @brief Moves the solenoid to the stop position without logging, so that
+     * it is safe to call from an ISR.
+     *
+     */
+    void stop();
 };
\ No newline at end of file
@@ -0,0 +1,84 @@
+/**
+ * @file reciprocal.cpp
+ * @brief Division free conversion from rotation period to rpm.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-21
+ */
+#include "reciprocal.h"
+
+// Number of bits of the mantissa used to index the table.
+#define RECIPROCAL_INDEX_BITS 6
+
+// 2^15 / m for m = 1 + i / 64, rounded. Evaluated by the compiler.
+#define RECIPROCAL_ENTRY(i) ((uint16_t)(32768.0 * 64 / (64 + (i)) + 0.5))
+#define RECIPROCAL_ENTRIES_4(i) RECIPROCAL_ENTRY(i), RECIPROCAL_ENTRY(i + 1), RECIPROCAL_ENTRY(i + 2), RECIPROCAL_ENTRY(i + 3)
+#define RECIPROCAL_ENTRIES_16(i) RECIPROCAL_ENTRIES_4(i), RECIPROCAL_ENTRIES_4(i + 4), RECIPROCAL_ENTRIES_4(i + 8), RECIPROCAL_ENTRIES_4(i + 12)
+
+const uint16_t reciprocalTable[(1 << RECIPROCAL_INDEX_BITS) + 1] PROGMEM = {
+    RECIPROCAL_ENTRIES_16(0),
+    RECIPROCAL_ENTRIES_16(16),
+    RECIPROCAL_ENTRIES_16(32),
+    RECIPROCAL_ENTRIES_16(48),
+    RECIPROCAL_ENTRY(64)};
+
+/**
+ * @brief Finds the number of places to shift a number right by to fit it in 16
+ * bits.
+ *
+ */
+static constexpr uint8_t shiftToFit16(const uint32_t value, const uint8_t shift = 0)
+{
+    return (value >> shift) < 0x10000 ? shift : shiftToFit16(value, shift + 1);
+}
+
+// The numerator as a 16 bit mantissa and a shift.
+static constexpr uint32_t RPM_NUMERATOR = 60000000UL * RPM_TICKS_PER_US;
+static constexpr uint8_t RPM_NUMERATOR_SHIFT = shiftToFit16(RPM_NUMERATOR);
+static constexpr uint16_t RPM_NUMERATOR_MANTISSA = (RPM_NUMERATOR + (1UL << RPM_NUMERATOR_SHIFT >> 1)) >> RPM_NUMERATOR_SHIFT;
+
+uint16_t periodToRpm(const uint32_t period)
+{
+    if (!period)
+    {
+        return 0xffff;
+    }
+
+    // Normalise so that the top bit is set. The period is then m * 2^(31 - zeros)
+    // with m in [1, 2) being the normalised value / 2^31.
+    uint32_t normalised = period;
+    uint8_t zeros = 0;
+    while (!(normalised & 0xff000000))
+    {
+        normalised <<= 8;
+        zeros += 8;
+    }
+    while (!(normalised & 0x80000000))
+    {
+        normalised <<= 1;
+        zeros++;
+    }
+
+    // Interpolate 2^15 / m from the table.
+    uint8_t index = (normalised >> (31 - RECIPROCAL_INDEX_BITS)) & ((1 << RECIPROCAL_INDEX_BITS) - 1);
+    uint16_t fraction = normalised >> (15 - RECIPROCAL_INDEX_BITS);
+    uint16_t low = pgm_read_word(&reciprocalTable[index]);
+    uint16_t high = pgm_read_word(&reciprocalTable[index + 1]);
+    uint16_t reciprocal = low - (uint16_t)(((uint32_t)(low - high) * fraction) >> 16);
+
+    // rpm = numerator / period
+    //     = mantissa * 2^numeratorShift * (2^15 / m) / 2^15 / 2^(31 - zeros)
+    uint32_t product = (uint32_t)RPM_NUMERATOR_MANTISSA * reciprocal;
+    int8_t shift = 46 - RPM_NUMERATOR_SHIFT - zeros;
+    if (shift <= 0)
+    {
+        return 0xffff;
+    }
+    if (shift >= 32)
+    {
+        return 0;
+    }
+    uint32_t rpm = (product + (1UL << (shift - 1))) >> shift;
+    return rpm > 0xffff ? 0xffff : rpm;
+}
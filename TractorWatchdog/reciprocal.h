@@ -0,0 +1,23 @@
+/**
+ * @file reciprocal.h
+ * @brief Division free conversion from rotation period to rpm.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-21
+ */
+#pragma once
+#include "defines.h"
+
+/**
+ * @brief Converts a rotation period to rpm without a 32 bit division.
+ *
+ * The period is normalised to a mantissa in [1, 2) and an exponent. The
+ * reciprocal of the mantissa is linearly interpolated from a table in PROGMEM
+ * and then scaled by the exponent. This is within 1 rpm of
+ * 60000000 * RPM_TICKS_PER_US / period between 100 and 3000 rpm.
+ *
+ * @param period the period in Timer1 ticks.
+ * @return uint16_t the rpm, or 0xffff if it is too large to fit.
+ */
+uint16_t periodToRpm(const uint32_t period);
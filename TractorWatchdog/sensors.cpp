@@ -7,16 +7,21 @@
  * @date 2023-10-15
  */
 #include "sensors.h"
+#include "reciprocal.h"
+#include "thermistor.h"
 
 extern State state;
-extern volatile uint32_t rpmCurTime, rpmPrevTime;
-extern volatile bool rpmRotationFlag;
+extern AdcSampler adcSampler;
+extern EepromWriter eepromWriter;
+extern EepromStore store;
+extern IsrQueue<uint32_t, RPM_QUEUE_LENGTH> rpmPeriods;
+extern volatile bool rpmOverRev;
 extern void rpmInterrupt();
 
 void SensorBattery::addState()
 {
-    uint32_t adc = analogRead(PIN_BATTERY);
-    state.voltage = adc * CAL_BATT_NUMERATOR / CAL_BATT_DENOMINATOR;
+    uint32_t adc = adcSampler.read(ADC_BATTERY);
+    state.update(state.voltage, adc * CAL_BATT_NUMERATOR / (CAL_BATT_DENOMINATOR * (uint32_t)ADC_OVERSAMPLE), STATE_VOLTAGE);
 }
 
 void SensorOil::begin()
@@ -26,39 +31,139 @@ void SensorOil::begin()
 
 void SensorOil::addState()
 {
-    state.oilPressure = !digitalRead(PIN_OIL_SW);
+    // Integrating debounce.
+    if (!digitalRead(PIN_OIL_SW))
+    {
+        if (integrator < OIL_DEBOUNCE_COUNT && ++integrator == OIL_DEBOUNCE_COUNT)
+        {
+            state.update(state.oilPressure, true, STATE_OIL);
+        }
+    }
+    else if (integrator && !--integrator)
+    {
+        state.update(state.oilPressure, false, STATE_OIL);
+    }
+
+    // Only expect pressure once the engine has been running for a while.
+    bool running = state.engineState == RUNNING;
+    if (running && !wasRunning)
+    {
+        startTime = millis();
+    }
+    wasRunning = running;
+    state.oilExpected = running && millis() - startTime >= OIL_START_GRACE;
 }
 
 void SensorTemperature::addState()
 {
-    state.temperature = (1023-analogRead(PIN_THERMISTOR_1)) / 7; // TODO: Calibration curve.
+    uint16_t firstReading = adcSampler.read(ADC_THERMISTOR_1);
+    uint16_t secondReading = adcSampler.read(ADC_THERMISTOR_2);
+    int16_t first = toCelsius(firstReading);
+    int16_t second = toCelsius(secondReading);
+    state.update(state.thermistors[0], first, STATE_TEMPERATURE);
+    state.update(state.thermistors[1], second, STATE_TEMPERATURE);
+
+    // Only stop the engine once there is no working thermistor left. A single
+    // failed one is a warning and the other is used on its own.
+    bool firstOk = probeOk(firstReading);
+#ifdef TEMP_PROBE_2_FITTED
+    bool secondOk = probeOk(secondReading);
+#else
+    bool secondOk = false;
+#endif
+    int16_t temperature = max(first, second);
+    if (firstOk != secondOk)
+    {
+        temperature = firstOk ? first : second;
+    }
+    state.update(state.temperature, temperature, STATE_TEMPERATURE);
+    state.probeFault = !firstOk && !secondOk;
+
+#ifdef TEMP_PROBE_2_FITTED
+    bool warning = firstOk != secondOk;
+    if (warning != state.probeWarning)
+    {
+        Serial.println(warning ? F("Thermistor failed, using the other") : F("Both thermistors ok"));
+        state.update(state.probeWarning, warning, STATE_TEMPERATURE);
+    }
+#endif
+
+#if defined(LIMIT_TEMPERATURE_DIFFERENCE) && defined(TEMP_PROBE_2_FITTED)
+    // Only a warning. The engine is never stopped for this.
+    bool disagree = firstOk && secondOk && abs(first - second) > LIMIT_TEMPERATURE_DIFFERENCE;
+    if (disagree != state.thermistorsDisagree)
+    {
+        Serial.println(disagree ? F("Thermistors disagree") : F("Thermistors agree"));
+        state.update(state.thermistorsDisagree, disagree, STATE_TEMPERATURE);
+    }
+#endif
+}
+
+int16_t SensorTemperature::toCelsius(const uint16_t reading)
+{
+    // Round from 1/16ths of a degree.
+    return (thermistorTemperature(reading) + 8) >> 4;
+}
+
+bool SensorTemperature::probeOk(const uint16_t reading)
+{
+    return reading >= THERMISTOR_SHORT_READING * (uint16_t)ADC_OVERSAMPLE &&
+           reading <= THERMISTOR_OPEN_READING * (uint16_t)ADC_OVERSAMPLE;
 }
 
 void SensorRPM::begin()
 {
     pinMode(PIN_RPM, INPUT);
+    reset();
+
+    // Run Timer1 freely at F_CPU / 8 for timing rotations, with an interrupt
+    // on overflow to extend it to 32 bits.
+    noInterrupts();
+    TCCR1A = 0;
+    TCNT1 = 0;
+#ifdef RPM_INPUT_CAPTURE
+    // Capture on the falling edge with the noise canceller on.
+    TCCR1B = _BV(ICNC1) | _BV(CS11);
+    TIFR1 = _BV(ICF1) | _BV(TOV1);
+    TIMSK1 = _BV(ICIE1) | _BV(TOIE1);
+#else
+    TCCR1B = _BV(CS11);
+    TIFR1 = _BV(TOV1);
+    TIMSK1 = _BV(TOIE1);
+#endif
+    interrupts();
+
+#ifndef RPM_INPUT_CAPTURE
     attachInterrupt(digitalPinToInterrupt(PIN_RPM), rpmInterrupt, FALLING);
+#endif
 }
 
 void SensorRPM::tick()
 {
-    if (rpmRotationFlag)
+    if (rpmOverRev)
     {
-        // A rotation happened since the last time.
-        rpmRotationFlag = false;
+        // The ISR already stopped the engine. Report it next time the state is
+        // checked.
+        state.overRevved = true;
+    }
 
-        // Disable interrupts whilst reading to avoid race conditions.
-        noInterrupts();
-        uint32_t rotationTime = rpmCurTime - rpmPrevTime;
-        interrupts();
+    uint32_t period;
+    bool rotated = false;
+    while (rpmPeriods.pop(period))
+    {
+        addPeriod(period);
+        rotated = true;
+    }
 
-        // Calculate the engine RPM
-        state.rpm = 60000000L / rotationTime;
+    if (rotated && averagedSum)
+    {
+        // Calculate the engine RPM from the average period.
+        state.update(state.rpm, periodToRpm(averagedSum / RPM_AVERAGE_REVS), STATE_RPM);
 
         // A rotation has occured, so the engine must be running.
         if (state.engineState == STOPPED)
         {
-            state.engineState = RUNNING;
+            state.update(state.engineState, RUNNING, STATE_ENGINE);
         }
     }
 }
@@ -66,127 +171,219 @@ void SensorRPM::tick()
 void SensorRPM::addState()
 {
     // Check if there hasn't been a rotation for a while.
-    noInterrupts();
-    uint32_t elapsed = micros() - rpmCurTime;
-    interrupts();
-    if (elapsed > 5000000)
+    if (millis() - lastRotation > RPM_STOPPED_TIME)
     {
         // Assume the RPM is 0.
-        state.rpm = 0;
+        state.update(state.rpm, 0, STATE_RPM);
+        reset();
 
         // Assume this means the engine is stopped.
         if (state.engineState == RUNNING)
         {
-            state.engineState = STOPPED;
+            state.update(state.engineState, STOPPED, STATE_ENGINE);
+        }
+    }
+}
+
+void SensorRPM::addPeriod(const uint32_t period)
+{
+    lastRotation = millis();
+    if (!primed)
+    {
+        // This period started before the engine stopped (or at power on), so
+        // is meaningless.
+        primed = true;
+        return;
+    }
+
+    // Reject single bad periods.
+    recent[recentIndex] = period;
+    recentIndex = recentIndex + 1 == RPM_MEDIAN_OF ? 0 : recentIndex + 1;
+    if (recentCount < RPM_MEDIAN_OF)
+    {
+        recentCount++;
+    }
+    uint32_t median = medianPeriod();
+
+    // Moving average. The window is filled with the first period so that the
+    // sum is always of RPM_AVERAGE_REVS periods.
+    if (!averagedSum)
+    {
+        for (uint8_t i = 0; i < RPM_AVERAGE_REVS; i++)
+        {
+            averaged[i] = median;
         }
+        averagedSum = median * RPM_AVERAGE_REVS;
     }
+    averagedSum += median - averaged[averagedIndex];
+    averaged[averagedIndex] = median;
+    averagedIndex = averagedIndex + 1 == RPM_AVERAGE_REVS ? 0 : averagedIndex + 1;
 }
 
+uint32_t SensorRPM::medianPeriod() const
+{
+    // Insertion sort a copy. RPM_MEDIAN_OF is small.
+    uint32_t sorted[RPM_MEDIAN_OF];
+    for (uint8_t i = 0; i < recentCount; i++)
+    {
+        uint32_t value = recent[i];
+        uint8_t j = i;
+        while (j && sorted[j - 1] > value)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+    return sorted[recentCount / 2];
+}
+
+void SensorRPM::reset()
+{
+    recentCount = 0;
+    recentIndex = 0;
+    averagedSum = 0;
+    averagedIndex = 0;
+    primed = false;
+}
+
+SensorTime::SensorTime() : journal(eepromWriter) {}
+
 void SensorTime::begin()
 {
-    EEPROMwl.begin(EEPROM_LAYOUT_VERSION, AMOUNT_OF_INDEXES);
     restoreEEPROM();
 }
 
 void SensorTime::tick()
 {
+    uint32_t now = millis();
+    bool stopped = false;
+
     // Did the engine just start or stop?
     if (state.engineState == RUNNING && !isRunning)
     {
         // Engine just started up.
         isRunning = true;
-        engineStartTimeTotal = millis();
-        engineStartTimeTrip = engineStartTimeTotal;
-
-        // Initial offsets
-        totalAtStart = state.totalMinutes;
-        tripAtStart = state.tripMinutes;
+        prevTime = now;
+        saveTime = now;
     }
     else if (state.engineState != RUNNING && isRunning)
     {
-        // Engine just stopped.
+        // Engine just stopped. Count the last bit of time and save.
         isRunning = false;
+        pendingMs += now - prevTime;
+        stopped = true;
     }
-
-    // If the engine is running, check if a minute has passed. If so, increment
-    // the times.
-    if (isRunning)
+    else if (isRunning)
     {
-        bool saveRequired = false;
-
-        // Calculate the new total time and update if needed.
-        uint32_t runningTimeTotal = (millis() - engineStartTimeTotal) / 60000;
-        uint32_t newTotal = totalAtStart + runningTimeTotal;
-        if (newTotal != state.totalMinutes)
-        {
-            // New time. Write to EEPROM and set state.
-            state.totalMinutes = newTotal;
-            saveRequired = true;
-        }
+        pendingMs += now - prevTime;
+        prevTime = now;
+    }
 
-        // Calculate the new total time and update if needed.
-        uint32_t runningTimeTrip = (millis() - engineStartTimeTrip) / 60000;
-        uint32_t newTrip = tripAtStart + runningTimeTrip;
-        if (newTrip != state.tripMinutes)
-        {
-            // New time. Write to EEPROM and set state.
-            state.tripMinutes = newTrip;
-            saveRequired = true;
-        }
+    // Count any whole seconds.
+    if (pendingMs >= 1000)
+    {
+        uint32_t seconds = pendingMs / 1000;
+        pendingMs -= seconds * 1000;
+        totalSeconds += seconds;
+        tripSeconds += seconds;
+        updateState();
+        journal.prepare(totalSeconds, tripSeconds); // Ready in case the power fails.
+    }
 
-        // Save to EEPROM if needed.
-        if (saveRequired)
-        {
-            saveEEPROM();
-        }
+    if (stopped || (isRunning && now - saveTime >= HOURS_SAVE_INTERVAL))
+    {
+        saveTime = now;
+        saveEEPROM();
+    }
+    else if (savePending)
+    {
+        // The last save didn't fit in the writer's queue. Queue what is
+        // prepared now, which is at least as new.
+        savePending = !journal.commit();
     }
 }
 
 void SensorTime::resetTrip()
 {
     Serial.println(F("Resetting trip time."));
-    state.tripMinutes = 0;
-    engineStartTimeTrip = millis();
+    tripSeconds = 0;
+    updateState();
     saveEEPROM();
 }
 
+void SensorTime::powerFail()
+{
+    // Wait for room in the writer's queue. It empties in the background.
+    while (!journal.commit())
+    {
+    }
+    savePending = false;
+}
+
 void SensorTime::restoreEEPROM()
 {
     Serial.println(F("Reading from EEPROM"));
-    EEPROMwl.get(0, state.totalMinutes);
-    EEPROMwl.get(1, state.tripMinutes);
+    journal.begin(store.address(STORE_HOURS), store.seed(STORE_HOURS));
+
+    // Always scan so that new records are written after anything that still
+    // looks valid (possible if the header was lost).
+    journal.restore(totalSeconds, tripSeconds);
+    if (store.isNew(STORE_HOURS))
+    {
+        totalSeconds = 0;
+        tripSeconds = 0;
+        if (store.legacy())
+        {
+            // Import from the old layout, which only had minutes. This has to
+            // happen before the store writes its header over it.
+            Serial.println(F("Importing from old layout"));
+            uint32_t totalMinutes = 0, tripMinutes = 0;
+            EEPROMwl.begin(LEGACY_LAYOUT_VERSION, AMOUNT_OF_INDEXES);
+            EEPROMwl.get(0, totalMinutes);
+            EEPROMwl.get(1, tripMinutes);
+            totalSeconds = totalMinutes * 60;
+            tripSeconds = tripMinutes * 60;
+        }
+        saveEEPROM();
+    }
+    updateState();
 }
 
 void SensorTime::saveEEPROM()
 {
-    Serial.println(F("Writing to EEPROM"));
-    EEPROMwl.put(0, state.totalMinutes);
-    EEPROMwl.put(1, state.tripMinutes);
+    // If the writer is full, the record stays prepared and tick() retries.
+    savePending = !journal.save(totalSeconds, tripSeconds);
+}
+
+void SensorTime::updateState()
+{
+    state.update(state.totalMinutes, totalSeconds / 60, STATE_TOTAL);
+    state.update(state.tripMinutes, tripSeconds / 60, STATE_TRIP);
 }
 
 void SensorManager::begin()
 {
-    const uint8_t SENSOR_COUNT = sizeof(sensors) / sizeof(Sensor *);
-    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
-    {
-        sensors[i]->begin();
-    }
+    CallBegin call;
+    forEach(call);
 }
 
-void SensorManager::addState()
+bool SensorManager::addState(const uint32_t now)
 {
-    const uint8_t SENSOR_COUNT = sizeof(sensors) / sizeof(Sensor *);
-    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    // Most loops nothing will be due.
+    if ((int32_t)(now - nextTime) < 0)
     {
-        sensors[i]->addState();
+        return false;
     }
+
+    CallAddState call = {now, nextTimes, now + 0x7fffffff, 0, false};
+    forEach(call);
+    nextTime = call.nextTime;
+    return call.updated;
 }
 
 void SensorManager::tick()
 {
-    const uint8_t SENSOR_COUNT = sizeof(sensors) / sizeof(Sensor *);
-    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
-    {
-        sensors[i]->tick();
-    }
-}
\ No newline at end of file
+    CallTick call;
+    forEach(call);
+}
@@ -9,9 +9,17 @@
 #pragma once
 #include "defines.h"
 #include "state.h"
+#include "isrqueue.h"
+#include "adc.h"
+#include "journal.h"
+#include "store.h"
 
 /**
- * @brief Base class for all sensors
+ * @brief Base class for all sensors.
+ *
+ * SensorManager calls sensors through their own types rather than through
+ * virtual functions, so subclasses hide these methods rather than override
+ * them. The empty defaults get inlined away.
  *
  */
 class Sensor
@@ -21,19 +29,23 @@ public:
      * @brief Called to initialise during runtime if needed.
      *
      */
-    virtual void begin() {}
+    void begin() {}
 
     /**
      * @brief Takes a reading and updates the global state variable.
      *
      */
-    virtual void addState() {}
+    void addState() {}
 
     /**
      * @brief Called regularly.
      *
      */
-    virtual void tick() {}
+    void tick() {}
+
+    // Time in ms between calls to addState(), or 0 if it doesn't need to be
+    // called.
+    static const uint16_t PERIOD = 0;
 };
 
 /**
@@ -43,11 +55,13 @@ public:
 class SensorBattery : public Sensor
 {
 public:
+    static const uint16_t PERIOD = SENSOR_PERIOD_BATTERY;
+
     /**
      * @brief Measures the battery voltage.
      *
      */
-    virtual void addState();
+    void addState();
 };
 
 /**
@@ -57,17 +71,27 @@ public:
 class SensorOil : public Sensor
 {
 public:
+    static const uint16_t PERIOD = SENSOR_PERIOD_OIL;
+
     /**
      * @brief Sets up the input pins.
      *
      */
-    virtual void begin();
+    void begin();
 
     /**
-     * @brief Checks if the oil pressure switch is tripped.
+     * @brief Samples the oil pressure switch.
      *
+     * Each sample moves a counter towards 0 (no pressure) or
+     * OIL_DEBOUNCE_COUNT (pressure) and the state only changes once an end is
+     * reached, so bounce and single glitches are ignored.
      */
-    virtual void addState();
+    void addState();
+
+private:
+    uint8_t integrator = 0;
+    bool wasRunning = false;
+    uint32_t startTime; // When the engine started running.
 };
 
 /**
@@ -77,11 +101,31 @@ public:
 class SensorTemperature : public Sensor
 {
 public:
+    static const uint16_t PERIOD = SENSOR_PERIOD_TEMPERATURE;
+
+    /**
+     * @brief Measures the temperature of both thermistors.
+     *
+     * Both are sampled by the ADC in the background, so this doesn't wait.
+     */
+    void addState();
+
+private:
+    /**
+     * @brief Converts a thermistor reading to a temperature.
+     *
+     * @param reading the oversampled ADC reading.
+     * @return int16_t the temperature in degrees C.
+     */
+    static int16_t toCelsius(const uint16_t reading);
+
     /**
-     * @brief Measures the temperature.
+     * @brief Checks that a reading isn't at either end of the range, which
+     * would be an open or shorted thermistor rather than a temperature.
      *
+     * @param reading the oversampled ADC reading.
      */
-    virtual void addState();
+    static bool probeOk(const uint16_t reading);
 };
 
 /**
@@ -91,25 +135,62 @@ public:
 class SensorRPM : public Sensor
 {
 public:
+    static const uint16_t PERIOD = SENSOR_PERIOD_RPM;
+
     /**
      * @brief Initialises the interrupts and pins.
      *
      */
-    virtual void begin();
+    void begin();
 
     /**
      * @brief Because this is interrupt based, updates on a tick instead of
      * addState.
      *
      */
-    virtual void tick();
+    void tick();
 
     /**
      * @brief Checks if there hasn't been an interrupt recently.
      *
      * Resets the rpm to 0 if so.
      */
-    virtual void addState();
+    void addState();
+
+private:
+    /**
+     * @brief Adds a rotation period to the filters.
+     *
+     * @param period the period in Timer1 ticks.
+     */
+    void addPeriod(const uint32_t period);
+
+    /**
+     * @brief Calculates the median of the last RPM_MEDIAN_OF periods.
+     *
+     * @return uint32_t the median period.
+     */
+    uint32_t medianPeriod() const;
+
+    /**
+     * @brief Empties the filters so that old periods aren't used once the
+     * engine starts again.
+     *
+     */
+    void reset();
+
+    // Raw periods for rejecting single bounced or missed pulses.
+    uint32_t recent[RPM_MEDIAN_OF];
+    uint8_t recentCount;
+    uint8_t recentIndex;
+
+    // Median filtered periods that are averaged.
+    uint32_t averaged[RPM_AVERAGE_REVS];
+    uint32_t averagedSum; // 0 when empty.
+    uint8_t averagedIndex;
+
+    bool primed; // Whether the period from the last stop to the first pulse was discarded.
+    uint32_t lastRotation; // millis() at the last time a period was received.
 };
 
 /**
@@ -121,45 +202,72 @@ class SensorTime : public Sensor
 {
 public:
     /**
-     * @brief Initialises the EEPROM and loads any existing times from it.
+     * @brief Construct a new Sensor Time object.
+     *
+     */
+    SensorTime();
+
+    /**
+     * @brief Loads any existing times from EEPROM.
      * 
      */
-    virtual void begin();
+    void begin();
 
     /**
      * @brief Updates the time as needed.
      * 
      */
-    virtual void tick();
+    void tick();
 
     /**
      * @brief Resets the trip time
      * 
      */
-    virtual void resetTrip();
+    void resetTrip();
+
+    /**
+     * @brief Queues the latest times to be saved straight away because the
+     * power is failing.
+     *
+     */
+    void powerFail();
 
 private:
     /**
-     * @brief Saves the times stored in the state variable to EEPROM.
+     * @brief Queues the times to be saved to EEPROM in the background.
      * 
      */
     void saveEEPROM();
 
     /**
-     * @brief Restores the times stored in the state variable from EEPROM.
+     * @brief Restores the times from EEPROM, importing them from the old
+     * EEPROMWearLevel layout if there is no journal yet.
      * 
      */
     void restoreEEPROM();
 
+    /**
+     * @brief Sets the minutes in the state variable from the seconds.
+     *
+     */
+    void updateState();
+
+    HoursJournal journal;
     bool isRunning = false;
-    uint32_t engineStartTimeTotal = 0;
-    uint32_t engineStartTimeTrip = 0; // Separate so this can be reset independently.
-    uint32_t totalAtStart, tripAtStart;
+    uint32_t totalSeconds = 0;
+    uint32_t tripSeconds = 0;
+    uint32_t pendingMs = 0; // Running time that isn't a whole second yet. 32 bits in case loop() is held up.
+    uint32_t prevTime = 0; // millis() when the time was last counted.
+    uint32_t saveTime = 0; // millis() when the time was last saved.
+    bool savePending = false; // True if a save didn't fit in the writer's queue and needs retrying.
 };
 
 /**
  * @brief Class for managing sensors.
  *
+ * The sensors are a fixed list, so each is called directly (and can be
+ * inlined) by expanding a function object over all of them.
+ *
  */
 class SensorManager
 {
@@ -171,10 +279,13 @@ public:
     void begin();
 
     /**
-     * @brief Calls each sensor to take a reading.
+     * @brief Calls addState() for each sensor that is due.
      *
+     * @param now the current time in ms.
+     * @return true if any sensor took a reading.
+     * @return false if nothing was due.
      */
-    void addState();
+    bool addState(const uint32_t now);
 
     /**
      * @brief Calls tick for each sensor.
@@ -188,5 +299,84 @@ public:
     SensorRPM rpm;
     SensorTime time;
 
-    Sensor *const sensors[5] = {&battery, &oil, &temperature, &rpm, &time};
-};
\ No newline at end of file
+private:
+    /**
+     * @brief Calls a function object with each sensor.
+     *
+     * @param function the function object, with an operator() template that
+     *                 takes any sensor.
+     */
+    template <typename F>
+    void forEach(F &function)
+    {
+        callEach(function, battery, oil, temperature, rpm, time);
+    }
+
+    template <typename F>
+    static void callEach(F &) {}
+
+    template <typename F, typename S, typename... Rest>
+    static void callEach(F &function, S &sensor, Rest &...rest)
+    {
+        function(sensor);
+        callEach(function, rest...);
+    }
+
+    /**
+     * @brief Calls begin().
+     *
+     */
+    struct CallBegin
+    {
+        template <typename S>
+        void operator()(S &sensor) { sensor.begin(); }
+    };
+
+    /**
+     * @brief Calls tick().
+     *
+     */
+    struct CallTick
+    {
+        template <typename S>
+        void operator()(S &sensor) { sensor.tick(); }
+    };
+
+    /**
+     * @brief Calls addState() for each sensor that is due and works out when
+     * the next one is due.
+     *
+     */
+    struct CallAddState
+    {
+        uint32_t now;
+        uint32_t *nextTimes;
+        uint32_t nextTime;
+        uint8_t index;
+        bool updated;
+
+        template <typename S>
+        void operator()(S &sensor)
+        {
+            if (S::PERIOD)
+            {
+                if ((int32_t)(now - nextTimes[index]) >= 0)
+                {
+                    sensor.addState();
+                    nextTimes[index] = now + S::PERIOD;
+                    updated = true;
+                }
+
+                if ((int32_t)(nextTimes[index] - nextTime) < 0)
+                {
+                    nextTime = nextTimes[index];
+                }
+            }
+            index++;
+        }
+    };
+
+    static const uint8_t SENSOR_COUNT = 5;
+    uint32_t nextTimes[SENSOR_COUNT] = {}; // When each sensor is next due.
+    uint32_t nextTime = 0; // The earliest of nextTimes.
+};
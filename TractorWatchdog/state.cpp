@@ -12,22 +12,23 @@ bool State::updateEngineState()
 {
     bool wasOk = (engineState == RUNNING) || (engineState == STOPPED);
 
-    // TODO: Engine startup delay to build up oil pressure.
     // Order is the order that issues will be shown to the user.
-    if (!oilPressure)
+    if (!oilPressure && oilExpected)
     {
-        Serial.println(F("No oil pressure"));
-        engineState = OIL_PRESSURE;
+        setFault(OIL_PRESSURE, F("No oil pressure"));
+    }
+    else if (probeFault)
+    {
+        // Before over temperature, as a shorted thermistor reads hot.
+        setFault(TEMP_PROBE, F("Thermistor open or shorted"));
     }
     else if (temperature > LIMIT_TEMPERATURE)
     {
-        Serial.println(F("Over temperature"));
-        engineState = OVER_TEMP;
+        setFault(OVER_TEMP, F("Over temperature"));
     }
-    else if (rpm > LIMIT_REVS)
+    else if (rpm > LIMIT_REVS || overRevved)
     {
-        Serial.println(F("Over reving"));
-        engineState = OVER_REV;
+        setFault(OVER_REV, F("Over reving"));
     }
     else
     {
@@ -37,4 +38,21 @@ bool State::updateEngineState()
     
     // Something failed. Return false if the first time, true otherwise.
     return !wasOk;
-}
\ No newline at end of file
+}
+
+uint8_t State::takeChanges()
+{
+    uint8_t fields = changed;
+    changed = 0;
+    return fields;
+}
+
+void State::setFault(const EngineState fault, const __FlashStringHelper *message)
+{
+    // This is called every time a fast sensor updates, so only log changes.
+    if (engineState != fault)
+    {
+        Serial.println(message);
+        update(engineState, fault, STATE_ENGINE);
+    }
+}
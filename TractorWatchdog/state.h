@@ -20,24 +20,76 @@ enum EngineState
     STOPPED,
     OVER_TEMP,
     OVER_REV,
-    OIL_PRESSURE
+    OIL_PRESSURE,
+    TEMP_PROBE // No thermistor is left that isn't open or shorted.
+};
+
+/**
+ * @brief Bits for each field in State, used to record which have changed.
+ *
+ */
+enum StateField : uint8_t
+{
+    STATE_TEMPERATURE = 1 << 0,
+    STATE_VOLTAGE = 1 << 1,
+    STATE_TRIP = 1 << 2,
+    STATE_TOTAL = 1 << 3,
+    STATE_RPM = 1 << 4,
+    STATE_OIL = 1 << 5,
+    STATE_ENGINE = 1 << 6,
+    STATE_ALL = 0xff
 };
 
 /**
  * @brief Struct to hold the current state and parameters of the vehicle.
  *
+ * Fields should be set using update() so that displays can tell what changed.
+ *
  */
 class State
 {
 public:
-    int16_t temperature;
+    int16_t temperature; // Hottest of the working thermistors.
+    int16_t thermistors[2]; // Each thermistor (PIN_THERMISTOR_1 and PIN_THERMISTOR_2).
     uint8_t voltage;
     uint32_t tripMinutes;
     uint32_t totalMinutes;
     uint16_t rpm;
     bool oilPressure; // True if there is pressure.
+    bool oilExpected; // True once the engine has been running long enough to build up oil pressure.
+    bool overRevved; // True if the rpm ISR has already stopped the engine for over revving.
+    bool probeFault; // True if no thermistor is left that isn't open or shorted.
+    bool probeWarning; // Warning only. True if one thermistor is open or shorted and the other is being used.
+    bool thermistorsDisagree; // Warning only. True if the thermistors differ by more than LIMIT_TEMPERATURE_DIFFERENCE.
     EngineState engineState;
 
+    // Bitmask of StateFields changed since takeChanges() was last called.
+    uint8_t changed = STATE_ALL;
+
+    /**
+     * @brief Sets a field and marks it as changed if the value is different.
+     *
+     * @param field the field to set.
+     * @param value the new value.
+     * @param mask the StateField bit for the field.
+     */
+    template <typename T, typename V>
+    void update(T &field, const V value, const uint8_t mask)
+    {
+        T newValue = value;
+        if (field != newValue)
+        {
+            field = newValue;
+            changed |= mask;
+        }
+    }
+
+    /**
+     * @brief Returns the fields that have changed and clears them.
+     *
+     */
+    uint8_t takeChanges();
+
     /**
      * @brief Updates the engineState attribute from the other state attributes.
      *
@@ -46,4 +98,13 @@ public:
      *               issues need to be cleared before this can go true again).
      */
     bool updateEngineState();
+
+private:
+    /**
+     * @brief Sets engineState to an error, logging it if it is new.
+     *
+     * @param fault the error.
+     * @param message the message to log.
+     */
+    void setFault(const EngineState fault, const __FlashStringHelper *message);
 };
\ No newline at end of file
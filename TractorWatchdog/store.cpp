@@ -0,0 +1,146 @@
+/**
+ * @file store.cpp
+ * @brief Directory of the typed, versioned records kept in EEPROM.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-25
+ */
+#include "store.h"
+#include "journal.h"
+#include "faults.h"
+#include "trend.h"
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+#define STORE_MAGIC 0x5754 // "TW"
+
+/**
+ * @brief A record in the layout.
+ *
+ */
+struct StoreLayout
+{
+    uint8_t type;
+    uint8_t version;
+    uint16_t length;
+};
+
+// Records in the order they are placed after the header, which is the order of
+// StoreRecord.
+static const StoreLayout STORE_LAYOUT[STORE_RECORD_TYPES] PROGMEM = {
+    {STORE_HOURS, 1, HOURS_JOURNAL_SLOTS * sizeof(HoursRecord)},
+    {STORE_FAULTS, 1, FAULT_LOG_ENTRIES * sizeof(FaultEntry)},
+    {STORE_TRENDS, 2, TREND_BLOCKS * sizeof(TrendBlock)}};
+
+static_assert(sizeof(StoreHeader) + HOURS_JOURNAL_SLOTS * sizeof(HoursRecord) + FAULT_LOG_ENTRIES * sizeof(FaultEntry) + TREND_BLOCKS * sizeof(TrendBlock) <= E2END + 1, "The records don't fit in EEPROM.");
+
+/**
+ * @brief Calculates the CRC of the header, excluding the CRC.
+ *
+ */
+static uint16_t headerCrc(const StoreHeader &header)
+{
+    uint16_t crc = 0xffff;
+    const uint8_t *bytes = (const uint8_t *)&header;
+    for (uint8_t i = 0; i < offsetof(StoreHeader, crc); i++)
+    {
+        crc = _crc_ccitt_update(crc, bytes[i]);
+    }
+    return crc;
+}
+
+void EepromStore::begin()
+{
+    StoreHeader old;
+    EepromWriter::get(0, old);
+    const bool hadHeader = old.magic == STORE_MAGIC && old.count <= STORE_MAX_RECORDS && old.crc == headerCrc(old);
+    if (!hadHeader)
+    {
+        // EEPROMWearLevel keeps its layout version in the first byte, where
+        // the magic would be.
+        legacyLayout = EepromWriter::read(0) == LEGACY_LAYOUT_VERSION;
+        old.count = 0;
+    }
+
+    // Keep any records that are the same and give new ones a seed that hasn't
+    // been used. Entries are found by type, so the order doesn't matter.
+    uint8_t newSeed = 1;
+    for (uint8_t i = 0; i < old.count; i++)
+    {
+        if (old.entries[i].seed >= newSeed)
+        {
+            newSeed = old.entries[i].seed + 1;
+        }
+    }
+
+    uint16_t next = sizeof(StoreHeader);
+    for (uint8_t i = 0; i < STORE_RECORD_TYPES; i++)
+    {
+        StoreLayout layout;
+        memcpy_P(&layout, &STORE_LAYOUT[i], sizeof(layout));
+        seeds[i] = newSeed;
+        newRecords |= _BV(i);
+        for (uint8_t j = 0; j < old.count; j++)
+        {
+            const StoreEntry &entry = old.entries[j];
+            if (entry.type == layout.type && entry.version == layout.version && entry.address == next && entry.length == layout.length)
+            {
+                seeds[i] = entry.seed;
+                newRecords &= ~_BV(i);
+            }
+        }
+        next += layout.length;
+    }
+
+    changed = newRecords || old.layoutVersion != EEPROM_LAYOUT_VERSION || old.count != STORE_RECORD_TYPES;
+    if (changed)
+    {
+        Serial.println(F("Updating EEPROM layout"));
+    }
+}
+
+void EepromStore::save()
+{
+    if (!changed)
+    {
+        return;
+    }
+
+    StoreHeader header;
+    header.magic = STORE_MAGIC;
+    header.layoutVersion = EEPROM_LAYOUT_VERSION;
+    header.count = STORE_RECORD_TYPES;
+    uint16_t next = sizeof(StoreHeader);
+    for (uint8_t i = 0; i < STORE_RECORD_TYPES; i++)
+    {
+        StoreLayout layout;
+        memcpy_P(&layout, &STORE_LAYOUT[i], sizeof(layout));
+        StoreEntry &entry = header.entries[i];
+        entry.type = layout.type;
+        entry.version = layout.version;
+        entry.seed = seeds[i];
+        entry.address = next;
+        entry.length = layout.length;
+        next += layout.length;
+    }
+    memset(&header.entries[STORE_RECORD_TYPES], 0, sizeof(header.entries) - STORE_RECORD_TYPES * sizeof(StoreEntry));
+    header.crc = headerCrc(header);
+
+    // Only happens when the firmware changes, so waiting is fine.
+    while (writer.busy())
+    {
+    }
+    EEPROM.put(0, header);
+    changed = false;
+}
+
+uint16_t EepromStore::address(const StoreRecord type) const
+{
+    uint16_t address = sizeof(StoreHeader);
+    for (uint8_t i = 0; i < type; i++)
+    {
+        address += pgm_read_word(&STORE_LAYOUT[i].length);
+    }
+    return address;
+}
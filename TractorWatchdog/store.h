@@ -0,0 +1,129 @@
+/**
+ * @file store.h
+ * @brief Directory of the typed, versioned records kept in EEPROM.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-25
+ */
+#pragma once
+#include "defines.h"
+#include "eepromwriter.h"
+
+/**
+ * @brief Types of record that can be stored. Values are saved in EEPROM so
+ * shouldn't be changed. Also the order records are placed in EEPROM, so only
+ * add to the end.
+ *
+ */
+enum StoreRecord : uint8_t
+{
+    STORE_HOURS,
+    STORE_FAULTS,
+    STORE_TRENDS,
+    STORE_RECORD_TYPES
+};
+
+static_assert(STORE_RECORD_TYPES <= STORE_MAX_RECORDS, "Increase STORE_MAX_RECORDS (this moves all records).");
+
+/**
+ * @brief An entry in the header's directory.
+ *
+ */
+struct StoreEntry
+{
+    uint8_t type;
+    uint8_t version; // Of the record's format.
+    uint8_t seed; // Mixed into the record's checksums so that data left from a previous layout isn't valid.
+    uint16_t address;
+    uint16_t length;
+} __attribute__((packed));
+
+/**
+ * @brief Header at the start of EEPROM listing where each record is.
+ *
+ */
+struct StoreHeader
+{
+    uint16_t magic;
+    uint8_t layoutVersion;
+    uint8_t count;
+    StoreEntry entries[STORE_MAX_RECORDS]; // The first count are used.
+    uint16_t crc;
+} __attribute__((packed));
+
+/**
+ * @brief Lays out the records in EEPROM and keeps track of which have data
+ * from before.
+ *
+ * The layout (STORE_LAYOUT in store.cpp) is fixed at compile time. On startup
+ * the header is read, and any record whose type, version, address and length
+ * all match the entry of the same type is kept. Anything else is new and gets a new seed, so old data in
+ * its area won't pass its checksums. No data needs to be erased or moved.
+ *
+ * The directory always has room for STORE_MAX_RECORDS, so the records start
+ * at the same address however many there are. To keep existing data when
+ * adding records, append them to the layout and increase
+ * EEPROM_LAYOUT_VERSION.
+ *
+ */
+class EepromStore
+{
+public:
+    /**
+     * @brief Construct a new Eeprom Store object.
+     *
+     * @param writer the background writer, which needs to be idle when the
+     *               header is written.
+     */
+    EepromStore(EepromWriter &writer) : writer(writer) {}
+
+    /**
+     * @brief Reads the header and works out what is new. Call before anything
+     * uses the records.
+     *
+     */
+    void begin();
+
+    /**
+     * @brief Writes the header if the layout changed. Call once everything
+     * that might need the old data (such as importing from the old layout)
+     * has read it.
+     *
+     */
+    void save();
+
+    /**
+     * @brief Gets the EEPROM address of a record.
+     *
+     */
+    uint16_t address(const StoreRecord type) const;
+
+    /**
+     * @brief Gets the seed to mix into a record's checksums.
+     *
+     */
+    uint8_t seed(const StoreRecord type) const { return seeds[type]; }
+
+    /**
+     * @brief Checks if a record has no data from before (new, moved or a
+     * different version).
+     *
+     */
+    bool isNew(const StoreRecord type) const { return newRecords & _BV(type); }
+
+    /**
+     * @brief Checks if EEPROM is in the old EEPROMWearLevel layout, which is
+     * when there is no header and the first byte is that layout's version.
+     * Blank or corrupt EEPROM isn't.
+     *
+     */
+    bool legacy() const { return legacyLayout; }
+
+private:
+    EepromWriter &writer;
+    uint8_t seeds[STORE_RECORD_TYPES];
+    uint8_t newRecords = 0; // Bit for each record that is new.
+    bool legacyLayout = false;
+    bool changed = false; // Whether the header needs writing.
+};
@@ -0,0 +1,136 @@
+/**
+ * @file thermistor.cpp
+ * @brief Conversion from thermistor readings to temperature.
+ *
+ * The thermistor is between the ADC pin and ground, with THERMISTOR_SERIES_R
+ * between the pin and the reference.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-22
+ */
+#include "thermistor.h"
+
+// Readings are scaled so that the full scale of the ADC is 2^16.
+#define THERMISTOR_FULL_SCALE (1024.0 * ADC_OVERSAMPLE)
+#define THERMISTOR_SEGMENTS (1 << THERMISTOR_SEGMENT_BITS)
+#define THERMISTOR_SEGMENT_SHIFT (10 + 6 - THERMISTOR_SEGMENT_BITS)
+
+static_assert(ADC_OVERSAMPLE == 64, "The table assumes readings are scaled to 16 bits.");
+
+/**
+ * @brief Sums the series for atanh(y) / y, which converges quickly for |y| <
+ * 1/3.
+ *
+ */
+static constexpr double atanhSeries(const double ySquared, const double term = 1, const uint8_t k = 1)
+{
+    return k > 39 ? 0 : term / k + atanhSeries(ySquared, term * ySquared, k + 2);
+}
+
+/**
+ * @brief Natural log of a number in [1, 2).
+ *
+ */
+static constexpr double logMantissa(const double x)
+{
+    return 2 * ((x - 1) / (x + 1)) * atanhSeries(((x - 1) / (x + 1)) * ((x - 1) / (x + 1)));
+}
+
+/**
+ * @brief Natural log that the compiler can evaluate.
+ *
+ */
+static constexpr double constLog(const double x)
+{
+    return x >= 2 ? 0.6931471805599453 + constLog(x / 2) : x < 1 ? constLog(x * 2) - 0.6931471805599453 : logMantissa(x);
+}
+
+/**
+ * @brief Temperature for a thermistor resistance from the Beta equation.
+ *
+ * @param resistance the resistance in ohms.
+ * @return constexpr double the temperature in degrees C.
+ */
+static constexpr double betaTemperature(const double resistance)
+{
+    return 1 / (1 / (THERMISTOR_T0 + 273.15) + constLog(resistance / THERMISTOR_R0) / THERMISTOR_BETA) - 273.15;
+}
+
+/**
+ * @brief Limits a temperature to the range of the table and converts it to
+ * 1/16ths of a degree.
+ *
+ */
+static constexpr int16_t toSixteenths(const double temperature)
+{
+    return temperature > THERMISTOR_MAX_TEMP   ? THERMISTOR_MAX_TEMP * 16
+           : temperature < THERMISTOR_MIN_TEMP ? THERMISTOR_MIN_TEMP * 16
+                                               : (int16_t)(temperature * 16 + (temperature < 0 ? -0.5 : 0.5));
+}
+
+/**
+ * @brief Table entry for the start of a segment.
+ *
+ * @param index the segment.
+ * @return constexpr int16_t the temperature in 1/16ths of a degree.
+ */
+static constexpr int16_t thermistorEntry(const uint16_t index)
+{
+    return index == 0 ? THERMISTOR_MAX_TEMP * 16
+           : index == THERMISTOR_SEGMENTS
+               ? THERMISTOR_MIN_TEMP * 16
+               : toSixteenths(betaTemperature(THERMISTOR_SERIES_R * (index << THERMISTOR_SEGMENT_SHIFT) /
+                                              (THERMISTOR_FULL_SCALE - (index << THERMISTOR_SEGMENT_SHIFT))));
+}
+
+/**
+ * @brief A list of indices for expanding into the table.
+ *
+ */
+template <uint16_t... I>
+struct Indices
+{
+};
+
+/**
+ * @brief Builds Indices<0, 1, ..., N - 1>.
+ *
+ */
+template <uint16_t N, uint16_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...>
+{
+};
+
+template <uint16_t... I>
+struct MakeIndices<0, I...>
+{
+    typedef Indices<I...> type;
+};
+
+/**
+ * @brief Holds the table, with an entry for each index.
+ *
+ */
+template <typename T>
+struct ThermistorTable;
+
+template <uint16_t... I>
+struct ThermistorTable<Indices<I...>>
+{
+    static const int16_t values[sizeof...(I)];
+};
+
+template <uint16_t... I>
+const int16_t ThermistorTable<Indices<I...>>::values[sizeof...(I)] PROGMEM = {thermistorEntry(I)...};
+
+typedef ThermistorTable<MakeIndices<THERMISTOR_SEGMENTS + 1>::type> Table;
+
+int16_t thermistorTemperature(const uint16_t reading)
+{
+    uint8_t index = reading >> THERMISTOR_SEGMENT_SHIFT;
+    uint16_t fraction = reading & ((1 << THERMISTOR_SEGMENT_SHIFT) - 1);
+    int16_t start = pgm_read_word(&Table::values[index]);
+    int16_t end = pgm_read_word(&Table::values[index + 1]);
+    return start + (int16_t)(((int32_t)(end - start) * fraction) >> THERMISTOR_SEGMENT_SHIFT);
+}
@@ -0,0 +1,21 @@
+/**
+ * @file thermistor.h
+ * @brief Conversion from thermistor readings to temperature.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-22
+ */
+#pragma once
+#include "defines.h"
+
+/**
+ * @brief Converts a thermistor reading to a temperature.
+ *
+ * Interpolates between points of a table that is calculated by the compiler
+ * from the Beta equation, so no floating point is used at runtime.
+ *
+ * @param reading the sum of ADC_OVERSAMPLE ADC readings of the divider.
+ * @return int16_t the temperature in 1/16ths of a degree C.
+ */
+int16_t thermistorTemperature(const uint16_t reading);
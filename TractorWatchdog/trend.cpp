@@ -0,0 +1,578 @@
+/**
+ * @file trend.cpp
+ * @brief Compressed log of per minute averages kept in EEPROM.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-27
+ */
+#include "trend.h"
+#include <util/crc16.h>
+
+extern State state;
+
+#define TREND_ESCAPE 8 // Rice quotients this large are escaped and the value stored as is.
+#define TREND_RAW_BITS 9 // Enough for any zig-zag encoded difference of 8 bit values.
+#define TREND_MEAN_SHIFT 4 // Running averages in TrendModel are over about 2^shift values.
+#define TREND_MAX_RICE_BITS 7
+#define TREND_CHUNK_LENGTH 16 // Most bytes of data to queue at a time.
+
+static const uint16_t TREND_DATA_BITS = sizeof(((TrendBlock *)0)->data) * 8;
+static_assert(TREND_DATA_BITS / 8 <= 255, "Byte positions in the data must fit in a uint8_t.");
+
+/**
+ * @brief Calculates the CRC for a commit.
+ *
+ * @param seed the record's seed.
+ * @param header the block's header.
+ * @param bits the length of the data.
+ * @param dataByte function returning a byte of the data from its index.
+ */
+template <typename F>
+static uint16_t trendCrc(const uint8_t seed, const TrendHeader &header, const uint16_t bits, F dataByte)
+{
+    uint16_t crc = 0xff00 | seed;
+    const uint8_t *bytes = (const uint8_t *)&header;
+    for (uint8_t i = 0; i < sizeof(TrendHeader); i++)
+    {
+        crc = _crc_ccitt_update(crc, bytes[i]);
+    }
+
+    // Only the valid bits of the last byte count, as more may have been
+    // written after this commit.
+    uint8_t length = (bits + 7) / 8;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        uint8_t value = dataByte(i);
+        if (i == bits / 8)
+        {
+            value &= 0xff00 >> (bits % 8);
+        }
+        crc = _crc_ccitt_update(crc, value);
+    }
+
+    crc = _crc_ccitt_update(crc, bits & 0xff);
+    return _crc_ccitt_update(crc, bits >> 8);
+}
+
+/**
+ * @brief Maps signed differences to unsigned so small negative ones are small
+ * too (0, -1, 1, -2, ... become 0, 1, 2, 3, ...).
+ *
+ */
+static inline uint16_t zigzag(const int16_t difference)
+{
+    return ((uint16_t)difference << 1) ^ (difference >> 15);
+}
+
+/**
+ * @brief Reverses zigzag().
+ *
+ */
+static inline int16_t unzigzag(const uint16_t value)
+{
+    return (value >> 1) ^ -(int16_t)(value & 1);
+}
+
+void TrendModel::reset(const uint8_t first[TREND_CHANNELS])
+{
+    for (uint8_t i = 0; i < TREND_CHANNELS; i++)
+    {
+        previous[i] = first[i];
+        means[i] = 0;
+    }
+}
+
+uint8_t TrendModel::riceBits(const uint8_t channel) const
+{
+    // Roughly log2 of the average value, but 0 until the average reaches 2
+    // as unary is best for mostly 0s and 1s.
+    uint8_t bits = 0;
+    while (bits < TREND_MAX_RICE_BITS && (2U << (TREND_MEAN_SHIFT + bits)) <= means[channel])
+    {
+        bits++;
+    }
+    return bits;
+}
+
+void TrendModel::update(const uint8_t channel, const uint16_t zigzag, const uint8_t value)
+{
+    means[channel] += zigzag - (means[channel] >> TREND_MEAN_SHIFT);
+    previous[channel] = value;
+}
+
+bool TrendReader::open(const uint16_t address, const uint8_t seed)
+{
+    EepromWriter::get(address, header);
+    dataAddress = address + offsetof(TrendBlock, data);
+
+    // Use the latest commit, or the second if the latest was cut off. Only
+    // one of them is written at a time, so the other is intact. Taking the
+    // longest valid one instead would trust a torn length that happened to
+    // match the old CRC.
+    bool found = false;
+    for (uint8_t i = 0; i < 2 && !found; i++)
+    {
+        TrendCommit commit;
+        EepromWriter::get(address + offsetof(TrendBlock, commits) + i * sizeof(TrendCommit), commit);
+        if (commit.bits <= TREND_DATA_BITS)
+        {
+            uint16_t crc = trendCrc(seed, header, commit.bits, [this](uint8_t index)
+                                    { return EepromWriter::read(dataAddress + index); });
+            if (commit.crc == crc)
+            {
+                found = true;
+                limit = commit.bits;
+            }
+        }
+    }
+
+    position = 0;
+    count = 0;
+    model.reset(header.first);
+    return found;
+}
+
+bool TrendReader::next(uint8_t values[TREND_CHANNELS])
+{
+    if (!count)
+    {
+        // The first sample is in the header.
+        memcpy(values, header.first, TREND_CHANNELS);
+        count++;
+        return true;
+    }
+
+    if (position >= limit)
+    {
+        return false;
+    }
+
+    // The second commit can end part way through a sample, so keep what is
+    // needed to drop it.
+    const TrendModel before = model;
+    const uint16_t start = position;
+    uint16_t coded[TREND_CHANNELS] = {0};
+    if (readBit())
+    {
+        coded[TREND_TEMPERATURE] = readRice(model.riceBits(TREND_TEMPERATURE));
+        if (readBit())
+        {
+            for (uint8_t i = TREND_TEMPERATURE + 1; i < TREND_CHANNELS; i++)
+            {
+                coded[i] = readRice(model.riceBits(i));
+            }
+        }
+    }
+    for (uint8_t i = 0; i < TREND_CHANNELS; i++)
+    {
+        values[i] = model.previous[i] + unzigzag(coded[i]);
+        model.update(i, coded[i], values[i]);
+    }
+
+    if (position > limit)
+    {
+        // Cut off.
+        model = before;
+        position = start;
+        limit = start;
+        return false;
+    }
+    count++;
+    return true;
+}
+
+bool TrendReader::current() const
+{
+    // The sequence is at the start of the block and written first.
+    uint16_t saved;
+    EepromWriter::get(dataAddress - offsetof(TrendBlock, data) + offsetof(TrendHeader, sequence), saved);
+    return saved == header.sequence;
+}
+
+bool TrendReader::readBit()
+{
+    if (position >= limit)
+    {
+        // Past the end of the commit. Counted so next() can tell.
+        position++;
+        return false;
+    }
+    uint8_t value = EepromWriter::read(dataAddress + position / 8);
+    bool bit = value & (0x80 >> (position % 8));
+    position++;
+    return bit;
+}
+
+uint16_t TrendReader::readBits(uint8_t length)
+{
+    uint16_t value = 0;
+    while (length--)
+    {
+        value = (value << 1) | readBit();
+    }
+    return value;
+}
+
+uint16_t TrendReader::readRice(const uint8_t lowBits)
+{
+    uint8_t quotient = 0;
+    while (quotient < TREND_ESCAPE && readBit())
+    {
+        quotient++;
+    }
+
+    if (quotient == TREND_ESCAPE)
+    {
+        return readBits(TREND_RAW_BITS);
+    }
+    return ((uint16_t)quotient << lowBits) | readBits(lowBits);
+}
+
+void TrendLogger::begin(const uint16_t address, const uint8_t seed)
+{
+    startAddress = address;
+    crcSeed = seed;
+    minute = state.totalMinutes;
+    memset(sums, 0, sizeof(sums));
+    samples = 0;
+
+    // Find the newest block.
+    bool found = false;
+    for (uint8_t i = 0; i < TREND_BLOCKS; i++)
+    {
+        TrendReader reader;
+        if (reader.open(slotAddress(i), crcSeed) && (!found || (int16_t)(reader.sequence() - sequence) > 0))
+        {
+            found = true;
+            sequence = reader.sequence();
+            slot = i;
+        }
+    }
+
+    if (!found)
+    {
+        return;
+    }
+
+    // Carry on with the newest block if the next sample follows on from it,
+    // so each restart doesn't waste the rest of a block.
+    TrendReader reader;
+    reader.open(slotAddress(slot), crcSeed);
+    uint8_t values[TREND_CHANNELS];
+    while (reader.next(values))
+    {
+    }
+
+    if (reader.minute() + 1 == minute)
+    {
+        EepromWriter::get(slotAddress(slot), block);
+        bits = reader.position;
+        count = reader.count;
+        model = reader.model;
+
+        // Clear anything after the valid data so it can be appended to.
+        uint8_t used = (bits + 7) / 8;
+        if (bits % 8)
+        {
+            block.data[used - 1] &= 0xff00 >> (bits % 8);
+        }
+        memset(block.data + used, 0, sizeof(block.data) - used);
+
+        headerSaved = true;
+        savedBits = bits;
+        committedBits = bits;
+        checkpointed = false;
+        started = true;
+    }
+}
+
+void TrendLogger::tick(const uint32_t now)
+{
+    // Sample while the engine is running, which is when engine minutes count.
+    if (state.engineState == RUNNING && now - sampleTime >= TREND_SAMPLE_INTERVAL && samples != 0xff)
+    {
+        sampleTime = now;
+        sums[TREND_TEMPERATURE] += constrain(state.temperature, 0, 255);
+        sums[TREND_VOLTAGE] += state.voltage;
+        sums[TREND_RPM] += min(state.rpm / 32, 255);
+        samples++;
+    }
+
+    if (state.totalMinutes != minute)
+    {
+        if (state.totalMinutes == minute + 1 && samples)
+        {
+            // Add the average of the minute that just finished.
+            uint8_t values[TREND_CHANNELS];
+            for (uint8_t i = 0; i < TREND_CHANNELS; i++)
+            {
+                values[i] = (sums[i] + samples / 2) / samples;
+            }
+            add(values, minute);
+        }
+
+        minute = state.totalMinutes;
+        memset(sums, 0, sizeof(sums));
+        samples = 0;
+    }
+
+    save();
+
+    // Print the next line of the log if the serial buffer has room, so
+    // printing never holds up the loop.
+    if (dumpOut && dumpOut->availableForWrite() >= SERIAL_DUMP_SPACE)
+    {
+        printNext();
+    }
+}
+
+void TrendLogger::flush()
+{
+    while (!save())
+    {
+    }
+}
+
+bool TrendLogger::open(const uint8_t index, TrendReader &reader) const
+{
+    if (index >= TREND_BLOCKS)
+    {
+        return false;
+    }
+
+    // Blocks are written in slot order, so older ones are in the slots before.
+    uint8_t readSlot = (slot + TREND_BLOCKS - index) % TREND_BLOCKS;
+    return reader.open(slotAddress(readSlot), crcSeed) && reader.sequence() == (uint16_t)(sequence - index);
+}
+
+void TrendLogger::dump(Print &out)
+{
+    out.println(F("Trend log (oldest first). Averages over each engine minute."));
+    out.println(F("Minute,Temperature,Voltage,RPM"));
+    dumpOut = &out;
+    dumpSequence = sequence - (TREND_BLOCKS - 1);
+    dumpOpen = false;
+}
+
+void TrendLogger::printNext()
+{
+    if (!dumpOpen)
+    {
+        // Open the next block. Blocks are followed by sequence so that one
+        // started part way doesn't upset the order.
+        if ((int16_t)(dumpSequence - sequence) > 0)
+        {
+            // Printed everything.
+            dumpOut = nullptr;
+            return;
+        }
+        const uint16_t index = sequence - dumpSequence;
+        dumpOpen = index < TREND_BLOCKS && open(index, dumpReader);
+        dumpSequence++;
+        return;
+    }
+
+    uint8_t values[TREND_CHANNELS];
+    if (!dumpReader.current() || !dumpReader.next(values))
+    {
+        // Finished the block or it has been replaced by a new one.
+        dumpOpen = false;
+        return;
+    }
+
+    Print &out = *dumpOut;
+    out.print(dumpReader.minute());
+    out.write(',');
+    out.print(values[TREND_TEMPERATURE]);
+    out.write(',');
+    out.print(values[TREND_VOLTAGE] / 10);
+    out.write('.');
+    out.print(values[TREND_VOLTAGE] % 10);
+    out.write(',');
+    out.println(values[TREND_RPM] * 32);
+}
+
+void TrendLogger::add(const uint8_t values[TREND_CHANNELS], const uint32_t minute)
+{
+    if (!started || minute != block.header.startMinute + count || !encode(values))
+    {
+        startBlock(values, minute);
+    }
+}
+
+void TrendLogger::startBlock(const uint8_t values[TREND_CHANNELS], const uint32_t minute)
+{
+    sequence++;
+    slot = slot + 1 == TREND_BLOCKS ? 0 : slot + 1;
+    block.header.sequence = sequence;
+    block.header.startMinute = minute;
+    memcpy(block.header.first, values, TREND_CHANNELS);
+    memset(block.data, 0, sizeof(block.data));
+    model.reset(values);
+    bits = 0;
+    count = 1;
+
+    // The commits left in EEPROM are for the old header, so are invalid.
+    headerSaved = false;
+    savedBits = 0;
+    committedBits = 0xffff;
+    checkpointed = false;
+    started = true;
+}
+
+bool TrendLogger::encode(const uint8_t values[TREND_CHANNELS])
+{
+    // Work out the length first so nothing is changed if it doesn't fit.
+    uint16_t coded[TREND_CHANNELS];
+    uint16_t lengths[TREND_CHANNELS];
+    bool restChanged = false;
+    for (uint8_t i = 0; i < TREND_CHANNELS; i++)
+    {
+        coded[i] = zigzag((int16_t)values[i] - model.previous[i]);
+        uint16_t quotient = coded[i] >> model.riceBits(i);
+        lengths[i] = quotient < TREND_ESCAPE ? quotient + 1 + model.riceBits(i) : TREND_ESCAPE + TREND_RAW_BITS;
+        if (i != TREND_TEMPERATURE)
+        {
+            restChanged |= coded[i];
+        }
+    }
+
+    const bool changed = coded[TREND_TEMPERATURE] || restChanged;
+    uint16_t length = 1;
+    if (changed)
+    {
+        length += lengths[TREND_TEMPERATURE] + 1;
+        if (restChanged)
+        {
+            for (uint8_t i = TREND_TEMPERATURE + 1; i < TREND_CHANNELS; i++)
+            {
+                length += lengths[i];
+            }
+        }
+    }
+    if (bits + length > TREND_DATA_BITS)
+    {
+        return false;
+    }
+
+    writeBits(changed, 1);
+    if (changed)
+    {
+        writeRice(coded[TREND_TEMPERATURE], model.riceBits(TREND_TEMPERATURE));
+        writeBits(restChanged, 1);
+        if (restChanged)
+        {
+            for (uint8_t i = TREND_TEMPERATURE + 1; i < TREND_CHANNELS; i++)
+            {
+                writeRice(coded[i], model.riceBits(i));
+            }
+        }
+    }
+    for (uint8_t i = 0; i < TREND_CHANNELS; i++)
+    {
+        model.update(i, coded[i], values[i]);
+    }
+    count++;
+    return true;
+}
+
+void TrendLogger::writeBits(const uint16_t value, const uint8_t length)
+{
+    for (int8_t i = length - 1; i >= 0; i--)
+    {
+        if (value & (1U << i))
+        {
+            block.data[bits / 8] |= 0x80 >> (bits % 8);
+        }
+        bits++;
+    }
+}
+
+void TrendLogger::writeRice(const uint16_t value, const uint8_t lowBits)
+{
+    uint16_t quotient = value >> lowBits;
+    if (quotient >= TREND_ESCAPE)
+    {
+        writeBits(0xff, TREND_ESCAPE);
+        writeBits(value, TREND_RAW_BITS);
+        return;
+    }
+
+    writeBits(0xff, quotient);
+    writeBits(0, 1);
+    writeBits(value, lowBits);
+}
+
+bool TrendLogger::save()
+{
+    if (!started)
+    {
+        return true;
+    }
+
+    uint16_t address = slotAddress(slot);
+    if (!headerSaved)
+    {
+        if (!writer.write(address, &block.header, sizeof(block.header)))
+        {
+            return false;
+        }
+        headerSaved = true;
+    }
+
+    // Before rewriting the partly used byte at the end of what was saved,
+    // point the second commit at the whole bytes before it. Losing power part
+    // way through rewriting that byte can break the first commit, but not the
+    // second.
+    if (committedBits != bits && !checkpointed)
+    {
+        if (!writeCommit(1, committedBits == 0xffff ? 0 : committedBits & ~7))
+        {
+            return false;
+        }
+        checkpointed = true;
+    }
+
+    // New data, including the partly used byte at the end of what was saved.
+    if (savedBits != bits)
+    {
+        uint8_t start = savedBits / 8;
+        uint8_t length = min((bits + 7) / 8 - start, TREND_CHUNK_LENGTH);
+        if (!writer.write(address + offsetof(TrendBlock, data) + start, block.data + start, length))
+        {
+            return false;
+        }
+        savedBits = min((start + length) * 8, bits);
+        if (savedBits != bits)
+        {
+            return false;
+        }
+    }
+
+    // Commit after the data so that a commit is never ahead of its data.
+    if (committedBits != bits)
+    {
+        if (!writeCommit(0, bits))
+        {
+            return false;
+        }
+        committedBits = bits;
+        checkpointed = false;
+    }
+    return true;
+}
+
+bool TrendLogger::writeCommit(const uint8_t index, const uint16_t length)
+{
+    TrendCommit commit;
+    commit.bits = length;
+    commit.crc = trendCrc(crcSeed, block.header, length, [this](uint8_t index)
+                          { return block.data[index]; });
+    if (!writer.write(slotAddress(slot) + offsetof(TrendBlock, commits) + index * sizeof(TrendCommit), &commit, sizeof(commit)))
+    {
+        return false;
+    }
+    block.commits[index] = commit;
+    return true;
+}
@@ -0,0 +1,345 @@
+/**
+ * @file trend.h
+ * @brief Compressed log of per minute averages kept in EEPROM.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-27
+ */
+#pragma once
+#include "defines.h"
+#include "state.h"
+#include "eepromwriter.h"
+
+/**
+ * @brief Values saved each minute.
+ *
+ */
+enum TrendChannel : uint8_t
+{
+    TREND_TEMPERATURE, // C, limited to 0 to 255.
+    TREND_VOLTAGE, // Tenths of a volt.
+    TREND_RPM, // rpm / 32.
+    TREND_CHANNELS
+};
+
+/**
+ * @brief Start of a block, which is everything needed to decode it by itself.
+ *
+ */
+struct TrendHeader
+{
+    uint16_t sequence; // Increases by one each block, so the newest can be found.
+    uint32_t startMinute; // Engine minute of the first sample.
+    uint8_t first[TREND_CHANNELS]; // The first sample, stored as is.
+} __attribute__((packed));
+
+/**
+ * @brief Marks how much of a block's data is valid.
+ *
+ */
+struct TrendCommit
+{
+    uint16_t bits; // Length of the data.
+    uint16_t crc; // Of the header, the data up to bits and bits.
+} __attribute__((packed));
+
+/**
+ * @brief A block of samples, as stored in EEPROM.
+ *
+ * Data is only ever appended, so a commit stays valid as more is added after
+ * it. The first commit is the latest. The second only covers whole bytes and
+ * is moved up before each save, so it is still valid if losing power cuts off
+ * rewriting the partly used last byte or the first commit.
+ *
+ */
+struct TrendBlock
+{
+    TrendHeader header;
+    TrendCommit commits[2];
+    uint8_t data[TREND_BLOCK_LENGTH - sizeof(TrendHeader) - 2 * sizeof(TrendCommit)];
+} __attribute__((packed));
+
+/**
+ * @brief Adaptive state shared by the encoder and decoder, so that both pick
+ * the same Rice parameters without storing them.
+ *
+ */
+class TrendModel
+{
+public:
+    /**
+     * @brief Starts a new block.
+     *
+     * @param first the first sample of the block.
+     */
+    void reset(const uint8_t first[TREND_CHANNELS]);
+
+    /**
+     * @brief Gets the number of low bits to store as is for a channel's next
+     * value. Larger when the channel has been changing more.
+     *
+     */
+    uint8_t riceBits(const uint8_t channel) const;
+
+    /**
+     * @brief Updates the model with a coded value.
+     *
+     * @param channel the channel.
+     * @param zigzag the zig-zag encoded difference that was coded.
+     * @param value the value of the channel.
+     */
+    void update(const uint8_t channel, const uint16_t zigzag, const uint8_t value);
+
+    uint8_t previous[TREND_CHANNELS];
+
+private:
+    uint16_t means[TREND_CHANNELS]; // Running average of the zig-zag values, scaled up.
+};
+
+/**
+ * @brief Decodes a block straight from EEPROM a sample at a time, so no RAM
+ * is needed for the block.
+ *
+ */
+class TrendReader
+{
+public:
+    /**
+     * @brief Opens a block and checks it.
+     *
+     * @param address the EEPROM address of the block.
+     * @param seed mixed into the CRC so blocks from an old layout are invalid.
+     * @return true if the block is valid.
+     * @return false if there is no valid block.
+     */
+    bool open(const uint16_t address, const uint8_t seed);
+
+    /**
+     * @brief Decodes the next sample, oldest first.
+     *
+     * @param values where to put the sample.
+     * @return true if there was a sample.
+     * @return false if the end of the block has been reached.
+     */
+    bool next(uint8_t values[TREND_CHANNELS]);
+
+    /**
+     * @brief Gets the engine minute of the sample last returned by next().
+     *
+     */
+    uint32_t minute() const { return header.startMinute + count - 1; }
+
+    /**
+     * @brief Gets the sequence number of the block.
+     *
+     */
+    uint16_t sequence() const { return header.sequence; }
+
+    /**
+     * @brief Checks that the block in EEPROM hasn't been replaced by a newer
+     * one since it was opened.
+     *
+     */
+    bool current() const;
+
+private:
+    /**
+     * @brief Reads the next bit of the data.
+     *
+     */
+    bool readBit();
+
+    /**
+     * @brief Reads a number of bits, most significant first.
+     *
+     */
+    uint16_t readBits(uint8_t length);
+
+    /**
+     * @brief Reads a Rice coded value.
+     *
+     * @param lowBits the number of low bits stored as is.
+     */
+    uint16_t readRice(const uint8_t lowBits);
+
+    friend class TrendLogger; // To continue writing a block after a restart.
+    TrendHeader header;
+    TrendModel model;
+    uint16_t dataAddress;
+    uint16_t position; // Bits read.
+    uint16_t limit; // Valid bits.
+    uint16_t count; // Samples read.
+};
+
+/**
+ * @brief Averages the temperature, voltage and rpm over each engine minute and
+ * saves them to a ring of TREND_BLOCKS blocks in EEPROM.
+ *
+ * Each block starts with an uncompressed sample. After that, a sample where
+ * nothing changed is a single 0 bit. Otherwise there is a 1 bit and the
+ * temperature's difference to the last sample, then a bit for whether the
+ * other channels changed and their differences if they did. Temperature
+ * changes far more often than the rest, so this saves coding their zeros.
+ * Differences are zig-zag encoded (so small negative numbers are small too)
+ * and Rice coded with a parameter that adapts to how much the channel has
+ * been changing. Differences too large for Rice coding to be worth it are
+ * escaped and stored as is.
+ *
+ * Blocks are decoded by themselves, so the log can be read a block at a time.
+ * Samples are by engine minute and a block only holds consecutive minutes, so
+ * the time of each sample is known without saving it.
+ *
+ */
+class TrendLogger
+{
+public:
+    /**
+     * @brief Construct a new Trend Logger object.
+     *
+     * @param writer the writer to save with.
+     */
+    TrendLogger(EepromWriter &writer) : writer(writer) {}
+
+    /**
+     * @brief Finds the newest block and carries on with it if it ends at the
+     * current engine minute. Call after the hours have been restored.
+     *
+     * @param address the EEPROM address of the log.
+     * @param seed mixed into the CRC so blocks from an old layout are invalid.
+     */
+    void begin(const uint16_t address, const uint8_t seed);
+
+    /**
+     * @brief Samples the state while the engine is running, adds the average
+     * at the end of each engine minute, saves what hasn't been saved and
+     * prints the next line of the log if dump() was called.
+     *
+     * @param now the current time in ms.
+     */
+    void tick(const uint32_t now);
+
+    /**
+     * @brief Queues everything that hasn't been saved, waiting for room if
+     * needed. Used when the power is failing.
+     *
+     */
+    void flush();
+
+    /**
+     * @brief Opens a block for reading.
+     *
+     * @param index 0 for the newest, increasing for older ones.
+     * @param reader the reader to open the block with.
+     * @return true if the block exists.
+     * @return false if there is no valid block.
+     */
+    bool open(const uint8_t index, TrendReader &reader) const;
+
+    /**
+     * @brief Starts printing the whole log as CSV, oldest first. The titles
+     * are printed now and each line after them is printed by a later tick().
+     *
+     * @param out where to print to.
+     */
+    void dump(Print &out);
+
+private:
+    /**
+     * @brief Adds a sample, starting a new block if needed.
+     *
+     * @param values the sample.
+     * @param minute the engine minute of the sample.
+     */
+    void add(const uint8_t values[TREND_CHANNELS], const uint32_t minute);
+
+    /**
+     * @brief Starts a new block in the next slot.
+     *
+     * @param values the first sample.
+     * @param minute the engine minute of the sample.
+     */
+    void startBlock(const uint8_t values[TREND_CHANNELS], const uint32_t minute);
+
+    /**
+     * @brief Appends a sample to the current block.
+     *
+     * @return true if it was added.
+     * @return false if there isn't room. Nothing is changed.
+     */
+    bool encode(const uint8_t values[TREND_CHANNELS]);
+
+    /**
+     * @brief Appends bits to the data, most significant first.
+     *
+     */
+    void writeBits(const uint16_t value, const uint8_t length);
+
+    /**
+     * @brief Appends a Rice coded value to the data.
+     *
+     */
+    void writeRice(const uint16_t value, const uint8_t lowBits);
+
+    /**
+     * @brief Queues as much of what hasn't been saved as there is room for.
+     *
+     * @return true if everything is queued.
+     * @return false if there wasn't room for everything.
+     */
+    bool save();
+
+    /**
+     * @brief Queues a commit for the current block.
+     *
+     * @param index 0 for the latest, 1 for the one covering whole bytes.
+     * @param length bits of data to commit.
+     * @return true if it was queued.
+     * @return false if there wasn't room.
+     */
+    bool writeCommit(const uint8_t index, const uint16_t length);
+
+    /**
+     * @brief Prints the next line of the log started by dump(). Opening a
+     * block counts as a line, as it reads the whole block.
+     *
+     */
+    void printNext();
+
+    /**
+     * @brief Gets the EEPROM address of a slot.
+     *
+     */
+    uint16_t slotAddress(const uint8_t slot) const { return startAddress + slot * sizeof(TrendBlock); }
+
+    EepromWriter &writer;
+    uint16_t startAddress;
+    uint8_t crcSeed;
+    uint16_t sequence = 0; // Of the newest block.
+    uint8_t slot = TREND_BLOCKS - 1; // Of the newest block.
+
+    // The block being written.
+    bool started = false;
+    TrendBlock block;
+    TrendModel model;
+    uint16_t bits; // Of data.
+    uint16_t count; // Samples.
+
+    // How much of the block has been queued.
+    bool headerSaved;
+    uint16_t savedBits;
+    uint16_t committedBits; // By the latest commit, or 0xffff if none.
+    bool checkpointed; // Whether the second commit has been moved up for the next save.
+
+    // Averaging over the current minute.
+    uint32_t minute;
+    uint32_t sampleTime = 0;
+    uint16_t sums[TREND_CHANNELS];
+    uint8_t samples;
+
+    // Printing the log a line at a time.
+    Print *dumpOut = nullptr; // nullptr when not printing.
+    uint16_t dumpSequence; // Of the next block to open.
+    bool dumpOpen; // Whether dumpReader has a block to print.
+    TrendReader dumpReader;
+};
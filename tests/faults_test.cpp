@@ -0,0 +1,221 @@
+/**
+ * @file faults_test.cpp
+ * @brief Checks that FaultRecorder saves the samples oldest first wherever the
+ * ring was up to, and that only complete entries with the expected sequence
+ * number are read back.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#include "faults.h"
+#include <stdio.h>
+
+#define FAULTS_ADDRESS 100
+#define FAULTS_SEED 5
+
+State state;
+static EepromWriter writer;
+static int failures = 0;
+static uint8_t nextTemperature = 0;
+
+static void expect(const bool ok, const char *message, const long detail)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s (%ld)\n", message, detail);
+        failures++;
+    }
+}
+
+/**
+ * @brief Takes samples, each with the next temperature so they can be told
+ * apart.
+ *
+ */
+static void takeSamples(FaultRecorder &recorder, const uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        state.temperature = nextTemperature++;
+        hostMillis += FAULT_SAMPLE_INTERVAL;
+        recorder.tick(hostMillis);
+    }
+}
+
+/**
+ * @brief Ticks with the EEPROM ready ISR run in between until the entry being
+ * saved is written. The time doesn't move, so no samples are taken.
+ *
+ */
+static void save(FaultRecorder &recorder)
+{
+    for (uint8_t i = 0; i < sizeof(FaultEntry); i++)
+    {
+        recorder.tick(hostMillis);
+        while (writer.busy())
+        {
+            writer.ready();
+        }
+    }
+}
+
+/**
+ * @brief Checks that an entry has the last used samples in order, ending with
+ * the one taken at the fault.
+ *
+ */
+static void expectSamples(const FaultEntry &entry, const uint8_t used, const uint8_t lastTemperature, const long detail)
+{
+    expect(entry.used == used, "wrong number of samples used", detail);
+    for (uint8_t i = 0; i < used; i++)
+    {
+        uint8_t expected = lastTemperature - (used - 1 - i);
+        if (entry.samples[FAULT_SAMPLES - used + i].temperature() != expected)
+        {
+            expect(false, "samples out of order", detail);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Records a fault at every position of the ring, checking the samples
+ * both while saving (from RAM) and once saved (from EEPROM).
+ *
+ */
+static void testRotation()
+{
+    memset(hostEeprom, 0xff, sizeof(hostEeprom));
+    FaultRecorder recorder(writer);
+    recorder.begin(FAULTS_ADDRESS, FAULTS_SEED);
+    for (uint8_t taken = 0; taken < 3 * FAULT_SAMPLES; taken++)
+    {
+        takeSamples(recorder, taken);
+        state.temperature = nextTemperature++;
+        recorder.record(OVER_TEMP);
+        uint8_t used = min(taken + 1, FAULT_SAMPLES);
+        uint8_t last = nextTemperature - 1;
+
+        FaultEntry entry;
+        expect(recorder.read(0, entry), "entry being saved not read", taken);
+        expectSamples(entry, used, last, taken);
+
+        // A fault while saving is ignored.
+        recorder.record(OVER_REV);
+        save(recorder);
+        expect(recorder.read(0, entry) && entry.fault == OVER_TEMP, "saved entry not read", taken);
+        expectSamples(entry, used, last, taken);
+
+        FaultSummary summary;
+        expect(recorder.read(0, summary) && summary.last.temperature() == last, "wrong summary", taken);
+    }
+}
+
+/**
+ * @brief Checks that older entries are found from the newest, that entries
+ * go when they are overwritten or corrupted, and that a torn entry is ignored
+ * after restarting.
+ *
+ */
+static void testCheck()
+{
+    memset(hostEeprom, 0xff, sizeof(hostEeprom));
+    FaultRecorder recorder(writer);
+    recorder.begin(FAULTS_ADDRESS, FAULTS_SEED);
+    FaultSummary summary;
+    expect(!recorder.read(0, summary), "blank EEPROM read", 0);
+
+    // One more than fits, so the first is overwritten.
+    for (uint8_t i = 0; i <= FAULT_LOG_ENTRIES; i++)
+    {
+        takeSamples(recorder, 1);
+        state.totalMinutes = 1000 + i;
+        recorder.record(OVER_TEMP);
+        save(recorder);
+    }
+    for (uint8_t index = 0; index < FAULT_LOG_ENTRIES; index++)
+    {
+        expect(recorder.read(index, summary) && summary.totalMinutes == 1000u + FAULT_LOG_ENTRIES - index, "wrong older entry", index);
+    }
+    expect(!recorder.read(FAULT_LOG_ENTRIES, summary), "read past the end", FAULT_LOG_ENTRIES);
+
+    // Restarting finds the same entries.
+    FaultRecorder restarted(writer);
+    restarted.begin(FAULTS_ADDRESS, FAULTS_SEED);
+    for (uint8_t index = 0; index < FAULT_LOG_ENTRIES; index++)
+    {
+        expect(restarted.read(index, summary) && summary.totalMinutes == 1000u + FAULT_LOG_ENTRIES - index, "wrong entry after restarting", index);
+    }
+
+    // A corrupted entry is skipped without losing the others.
+    static uint8_t saved[E2END + 1];
+    memcpy(saved, hostEeprom, sizeof(saved));
+    for (uint16_t address = FAULTS_ADDRESS; address < FAULTS_ADDRESS + FAULT_LOG_ENTRIES * sizeof(FaultEntry); address++)
+    {
+        memcpy(hostEeprom, saved, sizeof(saved));
+        hostEeprom[address] ^= 0x01;
+        uint8_t corrupted = 0;
+        for (uint8_t index = 0; index < FAULT_LOG_ENTRIES; index++)
+        {
+            if (!restarted.read(index, summary))
+            {
+                corrupted++;
+            }
+            else if (summary.totalMinutes != 1000u + FAULT_LOG_ENTRIES - index)
+            {
+                expect(false, "wrong entry next to a corrupted one", address);
+            }
+        }
+        expect(corrupted == 1, "corruption not found in exactly one entry", address);
+    }
+
+    // A complete entry that isn't the one expected in its slot is skipped.
+    memcpy(hostEeprom, saved, sizeof(saved));
+    uint16_t slots[FAULT_LOG_ENTRIES];
+    for (uint8_t slot = 0; slot < FAULT_LOG_ENTRIES; slot++)
+    {
+        uint32_t minutes;
+        memcpy(&minutes, hostEeprom + FAULTS_ADDRESS + slot * sizeof(FaultEntry) + offsetof(FaultEntry, totalMinutes), sizeof(minutes));
+        slots[1000 + FAULT_LOG_ENTRIES - minutes] = FAULTS_ADDRESS + slot * sizeof(FaultEntry);
+    }
+    memcpy(hostEeprom + slots[2], hostEeprom + slots[1], sizeof(FaultEntry));
+    expect(restarted.read(1, summary) && !restarted.read(2, summary), "stale copy of an entry read", 0);
+
+    // Power lost part way through saving an entry.
+    memcpy(hostEeprom, saved, sizeof(saved));
+    takeSamples(restarted, 1);
+    state.totalMinutes = 2000;
+    restarted.record(OVER_REV);
+    restarted.tick(hostMillis);
+    while (writer.busy())
+    {
+        writer.ready();
+    }
+    FaultRecorder afterCut(writer);
+    afterCut.begin(FAULTS_ADDRESS, FAULTS_SEED);
+    expect(afterCut.read(0, summary) && summary.totalMinutes == 1000u + FAULT_LOG_ENTRIES, "torn entry not ignored", 0);
+
+    // The next entry goes after the newest complete one.
+    takeSamples(afterCut, 1);
+    state.totalMinutes = 3000;
+    afterCut.record(OVER_REV);
+    save(afterCut);
+    FaultRecorder again(writer);
+    again.begin(FAULTS_ADDRESS, FAULTS_SEED);
+    expect(again.read(0, summary) && summary.totalMinutes == 3000 && summary.fault == OVER_REV, "entry after a torn one not read", 0);
+    expect(again.read(1, summary) && summary.totalMinutes == 1000u + FAULT_LOG_ENTRIES, "entry before a torn one lost", 0);
+}
+
+int main()
+{
+    state.engineState = RUNNING;
+    testRotation();
+    testCheck();
+    if (failures)
+    {
+        return 1;
+    }
+    printf("FaultRecorder: samples in order at every ring position, only complete and current entries read\n");
+    return 0;
+}
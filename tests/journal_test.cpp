@@ -0,0 +1,207 @@
+/**
+ * @file journal_test.cpp
+ * @brief Checks that HoursJournal restores the newest complete record through
+ * sequence number wraparound and torn or corrupted slots, and that
+ * EepromWriter turns away writes that don't fit without queuing any of them.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#include "journal.h"
+#include <stdio.h>
+
+#define JOURNAL_ADDRESS 48
+#define JOURNAL_SEED 5
+
+static EepromWriter writer;
+static int failures = 0;
+
+/**
+ * @brief Runs the EEPROM ready ISR until every queued write is done.
+ *
+ */
+static void drain()
+{
+    while (writer.busy())
+    {
+        writer.ready();
+    }
+}
+
+static void expect(const bool ok, const char *message, const long detail)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s (%ld)\n", message, detail);
+        failures++;
+    }
+}
+
+/**
+ * @brief Restores with a new journal, as happens on startup.
+ *
+ * @return true if a record was found and matches.
+ */
+static bool restores(HoursJournal &journal, const uint32_t totalSeconds, const uint32_t tripSeconds)
+{
+    journal.begin(JOURNAL_ADDRESS, JOURNAL_SEED);
+    uint32_t total = 0, trip = 0;
+    return journal.restore(total, trip) && total == totalSeconds && trip == tripSeconds;
+}
+
+/**
+ * @brief Restarts before every save, past the sequence number wrapping.
+ *
+ */
+static void testWraparound()
+{
+    memset(hostEeprom, 0xff, sizeof(hostEeprom));
+    HoursJournal blank(writer);
+    blank.begin(JOURNAL_ADDRESS, JOURNAL_SEED);
+    uint32_t total = 1, trip = 2;
+    expect(!blank.restore(total, trip) && total == 1 && trip == 2, "blank EEPROM restored something", 0);
+
+    for (uint32_t i = 1; i <= 0x10000 + 3 * HOURS_JOURNAL_SLOTS; i++)
+    {
+        HoursJournal journal(writer);
+        if (!restores(journal, (i - 1) * 7, i - 1) && i > 1)
+        {
+            expect(false, "wrong record after save", i - 1);
+            return;
+        }
+        expect(journal.save(i * 7, i), "save refused with an empty queue", i);
+        drain();
+    }
+}
+
+/**
+ * @brief Cuts the power part way through each byte of a save, leaving that
+ * byte as garbage, and also corrupts each byte of a finished save.
+ *
+ */
+static void testTorn()
+{
+    memset(hostEeprom, 0xff, sizeof(hostEeprom));
+    HoursJournal journal(writer);
+    restores(journal, 0, 0);
+    for (uint32_t i = 1; i <= HOURS_JOURNAL_SLOTS + 3; i++)
+    {
+        journal.save(i * 60, i);
+        drain();
+    }
+
+    // Find the bytes the next save changes.
+    static uint8_t before[E2END + 1], after[E2END + 1];
+    memcpy(before, hostEeprom, sizeof(before));
+    journal.save(1000, 1001);
+    drain();
+    memcpy(after, hostEeprom, sizeof(after));
+    uint16_t changed[sizeof(HoursRecord)];
+    uint8_t count = 0;
+    for (uint16_t address = 0; address <= E2END; address++)
+    {
+        if (before[address] != after[address])
+        {
+            changed[count++] = address;
+        }
+    }
+    expect(count > 0 && count <= sizeof(HoursRecord), "save changed an unexpected number of bytes", count);
+
+    const uint8_t GARBAGE[] = {0x00, 0xff, 0xa5, 0x5a};
+    for (uint8_t torn = 0; torn < count; torn++)
+    {
+        for (uint8_t g = 0; g < sizeof(GARBAGE); g++)
+        {
+            // Bytes are written in order, so the ones before are done.
+            memcpy(hostEeprom, before, sizeof(before));
+            for (uint8_t i = 0; i < torn; i++)
+            {
+                hostEeprom[changed[i]] = after[changed[i]];
+            }
+            hostEeprom[changed[torn]] = GARBAGE[g];
+            if (!memcmp(hostEeprom, after, sizeof(after)))
+            {
+                continue; // The garbage happened to be right.
+            }
+
+            HoursJournal restarted(writer);
+            expect(restores(restarted, (HOURS_JOURNAL_SLOTS + 3) * 60, HOURS_JOURNAL_SLOTS + 3), "torn save not ignored", torn);
+
+            // The next save must not go over the record that was restored.
+            restarted.save(2000, 2001);
+            drain();
+            HoursJournal again(writer);
+            expect(restores(again, 2000, 2001), "save after a torn one not restored", torn);
+        }
+    }
+
+    // Corrupt each byte of a finished record.
+    for (uint8_t i = 0; i < sizeof(HoursRecord); i++)
+    {
+        memcpy(hostEeprom, after, sizeof(after));
+        hostEeprom[changed[0] + i] ^= 0x10;
+        HoursJournal restarted(writer);
+        expect(restores(restarted, (HOURS_JOURNAL_SLOTS + 3) * 60, HOURS_JOURNAL_SLOTS + 3), "corrupted record not ignored", i);
+    }
+}
+
+/**
+ * @brief Fills the queue and checks that nothing from a refused write is
+ * written, then that a refused journal save can be committed later.
+ *
+ */
+static void testQueueFull()
+{
+    memset(hostEeprom, 0xff, sizeof(hostEeprom));
+    uint8_t data[10];
+    uint8_t accepted = 0;
+    while (true)
+    {
+        memset(data, accepted, sizeof(data));
+        if (!writer.write(500 + accepted * sizeof(data), data, sizeof(data)))
+        {
+            break;
+        }
+        accepted++;
+    }
+    // 3 bytes of header each and one slot left empty.
+    expect(accepted == (EEPROM_QUEUE_LENGTH - 1) / (sizeof(data) + 3), "wrong number of writes fitted", accepted);
+    drain();
+    for (uint16_t i = 0; i < (accepted + 1) * sizeof(data); i++)
+    {
+        uint8_t expected = i < accepted * sizeof(data) ? i / sizeof(data) : 0xff;
+        expect(hostEeprom[500 + i] == expected, "wrong byte after a refused write", i);
+    }
+
+    // Leave too little room for a record.
+    HoursJournal journal(writer);
+    journal.begin(JOURNAL_ADDRESS, JOURNAL_SEED);
+    uint8_t filler[EEPROM_QUEUE_LENGTH - sizeof(HoursRecord) - 2 * 3];
+    memset(filler, 0, sizeof(filler));
+    expect(writer.write(600, filler, sizeof(filler)), "filler refused", 0);
+    expect(!journal.save(3600, 60), "save fitted in a full queue", 0);
+    expect(!journal.commit(), "commit fitted in a full queue", 0);
+
+    // Newer times are prepared while waiting, and those are what get saved.
+    journal.prepare(3601, 61);
+    drain();
+    expect(journal.commit(), "commit refused with an empty queue", 0);
+    expect(journal.commit(), "nothing left to commit refused", 0);
+    drain();
+    HoursJournal restarted(writer);
+    expect(restores(restarted, 3601, 61), "committed record not restored", 0);
+}
+
+int main()
+{
+    testWraparound();
+    testTorn();
+    testQueueFull();
+    if (failures)
+    {
+        return 1;
+    }
+    printf("HoursJournal: restores through wraparound and torn saves, EepromWriter: refused writes not queued\n");
+    return 0;
+}
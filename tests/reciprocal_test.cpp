@@ -0,0 +1,61 @@
+/**
+ * @file reciprocal_test.cpp
+ * @brief Checks periodToRpm() against exact division for every period.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#include "reciprocal.h"
+#include <stdio.h>
+
+int main()
+{
+    const uint32_t NUMERATOR = 60000000UL * RPM_TICKS_PER_US;
+    int32_t worstInRange = 0, worstRelative = 0;
+    uint32_t worstPeriod = 0;
+    for (uint32_t period = 1; period <= NUMERATOR * 2; period++)
+    {
+        uint32_t exact = (NUMERATOR + period / 2) / period;
+        uint16_t rpm = periodToRpm(period);
+        if (exact > 0xffff)
+        {
+            if (rpm != 0xffff)
+            {
+                printf("FAIL: period %lu should saturate, got %u\n", (unsigned long)period, rpm);
+                return 1;
+            }
+            continue;
+        }
+
+        int32_t error = (int32_t)rpm - (int32_t)exact;
+        if (error < 0)
+        {
+            error = -error;
+        }
+
+        // Within 1 rpm over the documented 100 to 3000 rpm.
+        if (exact >= 100 && exact <= 3000 && error > worstInRange)
+        {
+            worstInRange = error;
+            worstPeriod = period;
+        }
+
+        // Everywhere else, within 0.1% (or 1 rpm).
+        int32_t relative = error > 1 ? error * 1000 / exact : 0;
+        if (relative > worstRelative)
+        {
+            worstRelative = relative;
+            worstPeriod = period;
+        }
+    }
+
+    printf("periodToRpm: worst error %ld rpm between 100 and 3000 rpm, worst elsewhere %ld/1000\n",
+           (long)worstInRange, (long)worstRelative);
+    if (worstInRange > 1 || worstRelative > 1)
+    {
+        printf("FAIL: worst at period %lu\n", (unsigned long)worstPeriod);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file Arduino.h
+ * @brief Just enough of the Arduino core to build the conversion and EEPROM
+ * code on a PC for the host tests.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+/**
+ * @brief Time in ms. Tests move it along with hostMillis.
+ *
+ */
+uint32_t millis();
+extern uint32_t hostMillis;
+
+/**
+ * @brief Interrupts never happen on their own on a PC, so these do nothing.
+ * Tests run the EEPROM ready ISR themselves.
+ *
+ */
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+/**
+ * @brief Prints numbers and strings as text, one byte at a time through
+ * write().
+ *
+ */
+class Print
+{
+public:
+    virtual size_t write(uint8_t value) = 0;
+    virtual int availableForWrite() { return 0; }
+
+    size_t print(const __FlashStringHelper *text) { return print(reinterpret_cast<const char *>(text)); }
+    size_t print(const char *text)
+    {
+        size_t length = 0;
+        while (*text)
+        {
+            length += write(*text++);
+        }
+        return length;
+    }
+    size_t print(char value) { return write(value); }
+    size_t print(int value) { return print((long)value); }
+    size_t print(unsigned int value) { return print((unsigned long)value); }
+    size_t print(long value)
+    {
+        char text[12];
+        snprintf(text, sizeof(text), "%ld", value);
+        return print(text);
+    }
+    size_t print(unsigned long value)
+    {
+        char text[12];
+        snprintf(text, sizeof(text), "%lu", value);
+        return print(text);
+    }
+
+    size_t println() { return print("\r\n"); }
+    template <typename T>
+    size_t println(const T value) { return print(value) + println(); }
+};
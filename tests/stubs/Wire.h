@@ -0,0 +1,9 @@
+/**
+ * @file Wire.h
+ * @brief Empty, as the code under test doesn't use it.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#pragma once
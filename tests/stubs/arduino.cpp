@@ -0,0 +1,37 @@
+/**
+ * @file arduino.cpp
+ * @brief Definitions for the stubs that need them.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#include <Arduino.h>
+
+uint32_t hostMillis = 0;
+
+uint32_t millis()
+{
+    return hostMillis;
+}
+
+uint8_t hostEeprom[E2END + 1];
+volatile uint16_t EEAR;
+volatile uint8_t EEDR;
+EepromControl EECR;
+
+EepromControl &EepromControl::operator|=(const uint8_t bits)
+{
+    value |= bits;
+    if (value & _BV(EERE))
+    {
+        EEDR = hostEeprom[EEAR % (E2END + 1)];
+        value &= ~_BV(EERE);
+    }
+    if (value & _BV(EEPE))
+    {
+        hostEeprom[EEAR % (E2END + 1)] = EEDR;
+        value &= ~(_BV(EEPE) | _BV(EEMPE));
+    }
+    return *this;
+}
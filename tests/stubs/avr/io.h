@@ -0,0 +1,45 @@
+/**
+ * @file io.h
+ * @brief The EEPROM registers, backed by an array on a PC.
+ *
+ * Setting EERE reads from hostEeprom into EEDR and setting EEPE writes EEDR to
+ * hostEeprom, both straight away, so EEPE is never seen as busy.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#pragma once
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+#define E2END 1023
+#define EERIE 3
+#define EEMPE 2
+#define EEPE 1
+#define EERE 0
+
+extern uint8_t hostEeprom[E2END + 1];
+extern volatile uint16_t EEAR;
+extern volatile uint8_t EEDR;
+
+/**
+ * @brief EEPROM control register that does the read or write when the bit
+ * that starts it is set.
+ *
+ */
+class EepromControl
+{
+public:
+    EepromControl &operator|=(const uint8_t bits);
+    EepromControl &operator&=(const uint8_t bits)
+    {
+        value &= bits;
+        return *this;
+    }
+    operator uint8_t() const { return value; }
+
+    uint8_t value = 0;
+};
+extern EepromControl EECR;
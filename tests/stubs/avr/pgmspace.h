@@ -0,0 +1,13 @@
+/**
+ * @file pgmspace.h
+ * @brief Program memory is ordinary memory on a PC.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#pragma once
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_word(address) (*(const uint16_t *)(address))
@@ -0,0 +1,18 @@
+/**
+ * @file crc16.h
+ * @brief The CRC from avr-libc, written out in C as given in its
+ * documentation.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#pragma once
+#include <stdint.h>
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+    data ^= crc & 0xff;
+    data ^= data << 4;
+    return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
@@ -0,0 +1,44 @@
+/**
+ * @file thermistor_test.cpp
+ * @brief Checks thermistorTemperature() against the Beta equation for every
+ * reading.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#include "thermistor.h"
+#include <math.h>
+#include <stdio.h>
+
+// Tolerances in degrees C. Tightest around the shutdown limit, looser at the
+// hot end where the table's segments are widest.
+#define TOLERANCE_TO_LIMIT 0.5 // 0C to LIMIT_TEMPERATURE.
+#define TOLERANCE_HOT 1.0 // LIMIT_TEMPERATURE to 130C.
+
+int main()
+{
+    double worstToLimit = 0, worstHot = 0;
+    for (uint32_t reading = 1; reading < 1024UL * ADC_OVERSAMPLE; reading++)
+    {
+        double resistance = THERMISTOR_SERIES_R * reading / (1024.0 * ADC_OVERSAMPLE - reading);
+        double exact = 1 / (1 / (THERMISTOR_T0 + 273.15) + log(resistance / THERMISTOR_R0) / THERMISTOR_BETA) - 273.15;
+        double error = fabs(thermistorTemperature(reading) / 16.0 - exact);
+        if (exact >= 0 && exact <= LIMIT_TEMPERATURE && error > worstToLimit)
+        {
+            worstToLimit = error;
+        }
+        else if (exact > LIMIT_TEMPERATURE && exact <= 130 && error > worstHot)
+        {
+            worstHot = error;
+        }
+    }
+
+    printf("thermistorTemperature: worst error %.2fC to " xstr(LIMIT_TEMPERATURE) "C, %.2fC above\n", worstToLimit, worstHot);
+    if (worstToLimit > TOLERANCE_TO_LIMIT || worstHot > TOLERANCE_HOT)
+    {
+        printf("FAIL\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file trend_power_test.cpp
+ * @brief Cuts the power while each byte of the trend log is being written and
+ * checks that what can be read back afterwards is correct and only the last
+ * few minutes are lost.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#include "trend.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TREND_ADDRESS 48
+#define TREND_SEED 5
+#define TREND_TEST_START_MINUTE 5000
+#define TREND_TEST_MINUTES 1500
+#define TREND_TEST_MAX_LOST 9 // Minutes. Up to a byte of steady samples, plus the one being saved.
+
+State state;
+static EepromWriter writer;
+static uint8_t logged[TREND_TEST_MINUTES][TREND_CHANNELS];
+static uint8_t live[E2END + 1];
+
+/**
+ * @brief Runs one engine minute, leaving its writes queued.
+ *
+ * Alternates between a few hundred minutes of noisy running and a few
+ * hundred steady, with an occasional change of rpm.
+ *
+ */
+static void runMinute(TrendLogger &logger, const uint16_t minute)
+{
+    static uint8_t temperature = 20, rpm = 40;
+    bool noisy = (minute / 300) % 2 == 0;
+    if (rand() % 20 == 0)
+    {
+        rpm = 30 + rand() % 25;
+    }
+    if (temperature < 85)
+    {
+        temperature += 2;
+    }
+    else if (noisy)
+    {
+        temperature += rand() % 3 - 1;
+    }
+
+    uint8_t *values = logged[minute];
+    values[TREND_TEMPERATURE] = temperature;
+    values[TREND_VOLTAGE] = 138 + (noisy ? rand() % 3 - 1 : 0);
+    values[TREND_RPM] = rpm + (noisy ? rand() % 3 - 1 : 0);
+
+    state.temperature = values[TREND_TEMPERATURE];
+    state.voltage = values[TREND_VOLTAGE];
+    state.rpm = values[TREND_RPM] * 32;
+    hostMillis += TREND_SAMPLE_INTERVAL;
+    logger.tick(hostMillis);
+    state.totalMinutes++;
+    logger.tick(hostMillis);
+}
+
+/**
+ * @brief Reads back every block as if after restarting.
+ *
+ * @return int32_t the newest minute read, or -1 if anything read was wrong.
+ */
+static int32_t newestReadBack()
+{
+    TrendLogger restarted(writer);
+    restarted.begin(TREND_ADDRESS, TREND_SEED);
+    int32_t newest = 0;
+    for (uint8_t index = 0; index < TREND_BLOCKS; index++)
+    {
+        TrendReader reader;
+        if (!restarted.open(index, reader))
+        {
+            continue;
+        }
+
+        uint8_t values[TREND_CHANNELS];
+        while (reader.next(values))
+        {
+            uint32_t minute = reader.minute() - TREND_TEST_START_MINUTE;
+            if (minute >= TREND_TEST_MINUTES || memcmp(values, logged[minute], TREND_CHANNELS))
+            {
+                return -1;
+            }
+            if ((int32_t)minute > newest)
+            {
+                newest = minute;
+            }
+        }
+    }
+    return newest;
+}
+
+int main()
+{
+    srand(1);
+    memset(hostEeprom, 0xff, sizeof(hostEeprom));
+    state.engineState = RUNNING;
+    state.totalMinutes = TREND_TEST_START_MINUTE;
+    TrendLogger logger(writer);
+    logger.begin(TREND_ADDRESS, TREND_SEED);
+
+    uint32_t cuts = 0;
+    int32_t worstLost = 0;
+    for (uint16_t minute = 0; minute < TREND_TEST_MINUTES; minute++)
+    {
+        runMinute(logger, minute);
+
+        // Write a byte at a time. After each, read back with that byte as
+        // garbage, as if the power went while it was being written.
+        while (writer.busy())
+        {
+            memcpy(live, hostEeprom, sizeof(live));
+            writer.ready();
+            int16_t written = -1;
+            for (uint16_t address = 0; address <= E2END; address++)
+            {
+                if (live[address] != hostEeprom[address])
+                {
+                    written = address;
+                }
+            }
+            if (written < 0)
+            {
+                continue;
+            }
+
+            memcpy(live, hostEeprom, sizeof(live));
+            const uint8_t garbage[] = {0x00, 0xff, (uint8_t)rand()};
+            for (uint8_t g = 0; g < sizeof(garbage); g++)
+            {
+                hostEeprom[written] = garbage[g];
+                int32_t newest = newestReadBack();
+                if (newest < 0)
+                {
+                    printf("FAIL: wrong data read back after a cut writing address %d in minute %u\n", written, minute);
+                    return 1;
+                }
+
+                // The first minute may not have been committed yet.
+                int32_t lost = minute - newest;
+                if (minute > 0 && lost > worstLost)
+                {
+                    worstLost = lost;
+                }
+                cuts++;
+            }
+            memcpy(hostEeprom, live, sizeof(live));
+        }
+    }
+
+    if (worstLost > TREND_TEST_MAX_LOST)
+    {
+        printf("FAIL: %ld minutes lost by a power cut\n", (long)worstLost);
+        return 1;
+    }
+    printf("TrendLogger: %lu power cuts, at most %ld minutes lost and nothing read wrong\n", (unsigned long)cuts, (long)worstLost);
+    return 0;
+}
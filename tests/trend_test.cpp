@@ -0,0 +1,119 @@
+/**
+ * @file trend_test.cpp
+ * @brief Checks that TrendLogger reads back what was logged when a change
+ * large enough to be escaped lands at every position near the end of a block.
+ *
+ * @author Jotham Gates
+ * @version 0.1
+ * @date 2023-10-28
+ */
+#include "trend.h"
+#include <stdio.h>
+
+#define TREND_ADDRESS 48
+#define TREND_SEED 5
+#define TREND_TEST_START_MINUTE 1000
+#define TREND_TEST_MINUTES 1200
+
+State state;
+static EepromWriter writer;
+static uint8_t logged[TREND_TEST_MINUTES][TREND_CHANNELS];
+
+/**
+ * @brief Runs one engine minute with the state held at the given values.
+ *
+ */
+static void runMinute(TrendLogger &logger, const uint8_t temperature, const uint8_t voltage, const uint8_t rpm)
+{
+    uint32_t index = state.totalMinutes - TREND_TEST_START_MINUTE;
+    logged[index][TREND_TEMPERATURE] = temperature;
+    logged[index][TREND_VOLTAGE] = voltage;
+    logged[index][TREND_RPM] = rpm;
+
+    state.temperature = temperature;
+    state.voltage = voltage;
+    state.rpm = rpm * 32;
+    hostMillis += TREND_SAMPLE_INTERVAL;
+    logger.tick(hostMillis);
+    state.totalMinutes++;
+    logger.tick(hostMillis);
+    while (writer.busy())
+    {
+        writer.ready();
+    }
+}
+
+/**
+ * @brief Reads back every block and compares it with what was logged.
+ *
+ * @return uint16_t the number of minutes read back, or 0 if any were wrong.
+ */
+static uint16_t readBack()
+{
+    // Read with a new logger, as if after restarting.
+    TrendLogger restarted(writer);
+    restarted.begin(TREND_ADDRESS, TREND_SEED);
+    uint16_t count = 0;
+    for (uint8_t index = 0; index < TREND_BLOCKS; index++)
+    {
+        TrendReader reader;
+        if (!restarted.open(index, reader))
+        {
+            continue;
+        }
+
+        uint8_t values[TREND_CHANNELS];
+        while (reader.next(values))
+        {
+            uint32_t minute = reader.minute() - TREND_TEST_START_MINUTE;
+            if (minute >= TREND_TEST_MINUTES || memcmp(values, logged[minute], TREND_CHANNELS))
+            {
+                return 0;
+            }
+            count++;
+        }
+    }
+    return count;
+}
+
+int main()
+{
+    state.engineState = RUNNING;
+
+    // Steady running puts the Rice parameters at their smallest, then a jump
+    // of 128 needs escaping. Each run starts the jump a minute later, so one
+    // lands at each position near the end of the first block.
+    const uint16_t STEADY_MAX = sizeof(((TrendBlock *)0)->data) * 8 + 20;
+    for (uint16_t steady = 0; steady <= STEADY_MAX; steady++)
+    {
+        for (uint8_t channel = 0; channel < TREND_CHANNELS; channel++)
+        {
+            memset(hostEeprom, 0xff, sizeof(hostEeprom));
+            state.totalMinutes = TREND_TEST_START_MINUTE;
+            TrendLogger logger(writer);
+            logger.begin(TREND_ADDRESS, TREND_SEED);
+
+            uint8_t values[TREND_CHANNELS] = {20, 138, 40};
+            for (uint16_t minute = 0; minute < steady; minute++)
+            {
+                runMinute(logger, values[0], values[1], values[2]);
+            }
+            values[channel] += 128;
+            for (uint8_t minute = 0; minute < 10; minute++)
+            {
+                runMinute(logger, values[0], values[1], values[2]);
+            }
+
+            uint16_t count = readBack();
+            if (count != steady + 10)
+            {
+                printf("FAIL: %u of %u minutes read back after a jump in channel %u after %u steady minutes\n",
+                       count, steady + 10, channel, steady);
+                return 1;
+            }
+        }
+    }
+
+    printf("TrendLogger: escaped changes read back after 0 to %u steady minutes, across the end of a block\n", STEADY_MAX);
+    return 0;
+}